@@ -0,0 +1,105 @@
+// approximate sampling against full sampling, along the same wander path as TerrainGeneratorTest.WanderingTest.
+// counts height samples and time for each, and the worst height error approximation actually let through.
+// usage: ApproximateSamplingBench [lattice step] [max error]
+
+#include "TerrainGenerator.hpp"
+#include "terrain/ApproximateSampling.hpp"
+#include "terrain/Vertex.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <vector>
+
+using namespace terraingen;
+
+// rolling hills
+struct SmoothSampler {
+  size_t samples = 0;
+
+  float Get(int x, int y) {
+    samples++;
+    return 40.0f * std::sin(x * 0.004f) * std::cos(y * 0.003f);
+  }
+};
+
+// the same hills, with ripples a few samples wide on top
+struct RoughSampler {
+  size_t samples = 0;
+
+  float Get(int x, int y) {
+    samples++;
+    return 40.0f * std::sin(x * 0.004f) * std::cos(y * 0.003f) + 0.5f * std::sin(x * 1.3f) * std::sin(y * 1.7f);
+  }
+};
+
+struct WanderResult {
+  size_t samples;
+  double seconds;
+  float max_error;
+};
+
+template <typename Sampler>
+WanderResult RunWander(const terrain::ApproximateSampling& settings) {
+  std::shared_ptr<Sampler> exact_sampler = std::make_shared<Sampler>();
+  std::shared_ptr<Sampler> approx_sampler = std::make_shared<Sampler>();
+  TerrainGenerator<Sampler> exact(exact_sampler, 4.0f, (1.0 / 2048.0), glm::vec3(0.0), 2048, 64, 256.0);
+  TerrainGenerator<Sampler> approx(approx_sampler, 4.0f, (1.0 / 2048.0), glm::vec3(0.0), 2048, 64, 256.0);
+  approx.SetApproximateSampling(settings);
+
+  std::vector<terrain::Vertex> exact_verts;
+  std::vector<terrain::Vertex> approx_verts;
+  double seconds = 0.0;
+  float max_error = 0.0f;
+  for (float theta = 0.0f; theta < M_PI * 2; theta += 0.1f) {
+    for (float radius = 63.0; radius < 1024.0; radius *= 2) {
+      glm::vec3 point(cos(theta) * 960.0 + radius, 0.5, sin(theta) * radius + 1024.0);
+      exact.UpdateChunkData(point);
+
+      auto start = std::chrono::steady_clock::now();
+      approx.UpdateChunkData(point);
+      seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+      // same trees and cache order, so chunks line up
+      exact_verts.resize(exact.GetVertexBufferSize() / sizeof(terrain::Vertex));
+      approx_verts.resize(approx.GetVertexBufferSize() / sizeof(terrain::Vertex));
+      exact.WriteVertexBuffer(exact_verts.data(), exact_verts.size() * sizeof(terrain::Vertex));
+      approx.WriteVertexBuffer(approx_verts.data(), approx_verts.size() * sizeof(terrain::Vertex));
+      for (size_t i = 0; i < std::min(exact_verts.size(), approx_verts.size()); i++) {
+        max_error = std::max(max_error, std::abs(exact_verts[i].position.y - approx_verts[i].position.y));
+      }
+    }
+  }
+
+  return { approx_sampler->samples, seconds, max_error };
+}
+
+template <typename Sampler>
+void PrintWander(const char* name, const terrain::ApproximateSampling& settings) {
+  WanderResult full = RunWander<Sampler>(terrain::ApproximateSampling());
+  WanderResult approx = RunWander<Sampler>(settings);
+  std::printf("%8s %14zu %14zu %12.3f %12.3f %12.4f\n", name, full.samples, approx.samples, full.seconds * 1000.0, approx.seconds * 1000.0, approx.max_error);
+}
+
+int main(int argc, char** argv) {
+  terrain::ApproximateSampling settings;
+  settings.min_chunk_size = 1;
+  settings.lattice_step = 4;
+  settings.max_error = 0.05f;
+  if (argc > 1) {
+    settings.lattice_step = static_cast<size_t>(std::strtoull(argv[1], nullptr, 10));
+  }
+
+  if (argc > 2) {
+    settings.max_error = std::strtof(argv[2], nullptr);
+  }
+
+  std::printf("lattice step %zu, max error %.4f\n", settings.lattice_step, settings.max_error);
+  std::printf("%8s %14s %14s %12s %12s %12s\n", "map", "full samples", "approx samples", "full (ms)", "approx (ms)", "worst error");
+  PrintWander<SmoothSampler>("smooth", settings);
+  PrintWander<RoughSampler>("rough", settings);
+  return 0;
+}
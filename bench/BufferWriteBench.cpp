@@ -0,0 +1,92 @@
+// buffer write throughput, against the number of threads writing.
+// builds a tree's worth of chunks once, then times vertex and index writes from the published snapshot.
+// usage: BufferWriteBench [repeats]
+
+#include "terrain/ChunkGenerator.hpp"
+#include "util/WorkStealingPool.hpp"
+#include "lod/lod_node.hpp"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <thread>
+#include <vector>
+
+using namespace terraingen;
+
+struct WaveSampler {
+  float Get(int x, int y) {
+    return static_cast<float>(16.0 * std::sin(x / 64.0) + 8.0 * std::cos(y / 32.0));
+  }
+};
+
+// full tree, split down to a fixed depth - 4^depth chunks
+static void Split(lod::lod_node* node, int depth) {
+  if (depth <= 0) {
+    return;
+  }
+
+  node->tl = lod::lod_node::lod_node_alloc();
+  node->tr = lod::lod_node::lod_node_alloc();
+  node->bl = lod::lod_node::lod_node_alloc();
+  node->br = lod::lod_node::lod_node_alloc();
+  Split(node->tl, depth - 1);
+  Split(node->tr, depth - 1);
+  Split(node->bl, depth - 1);
+  Split(node->br, depth - 1);
+}
+
+int main(int argc, char** argv) {
+  int repeats = 20;
+  if (argc > 1) {
+    repeats = std::atoi(argv[1]);
+  }
+
+  const size_t chunk_res = 64;
+  auto sampler = std::make_shared<WaveSampler>();
+  terrain::ChunkGenerator<WaveSampler> generator(sampler, 1.0f, (1.0 / 2048.0), glm::vec3(0.0f), chunk_res);
+
+  lod::lod_node* tree = lod::lod_node::lod_node_alloc();
+  Split(tree, 4);
+  generator.UpdateChunks(tree, 16384);
+
+  const size_t vertex_bytes = generator.GetVertexBufferSize();
+  const size_t index_bytes = generator.GetIndexBufferSize();
+  std::vector<unsigned char> vertices(vertex_bytes);
+  std::vector<unsigned char> indices(index_bytes);
+
+  std::printf("hardware threads: %u, %zu chunks, %.1f MB vertices, %.1f MB indices\n",
+    std::thread::hardware_concurrency(), generator.GetChunkCount(), vertex_bytes / 1048576.0, index_bytes / 1048576.0);
+  std::printf("%8s %10s %16s %16s\n", "threads", "streaming", "vertex (GB/s)", "index (GB/s)");
+  for (size_t threads : { 1, 2, 4, 8 }) {
+    for (bool streaming : { false, true }) {
+      generator.SetThreadCount(threads);
+      generator.SetStreamingWrites(streaming);
+
+      // everything's cached - this just republishes with the new settings
+      generator.UpdateChunks(tree, 16384);
+      auto snapshot = generator.GetSnapshot();
+
+      auto start = std::chrono::steady_clock::now();
+      for (int i = 0; i < repeats; i++) {
+        snapshot->WriteVertexBuffer(vertices.data(), vertex_bytes);
+      }
+
+      double vertex_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+      start = std::chrono::steady_clock::now();
+      for (int i = 0; i < repeats; i++) {
+        snapshot->WriteIndexBuffer(indices.data(), index_bytes);
+      }
+
+      double index_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+      std::printf("%8zu %10s %16.2f %16.2f\n", threads, (streaming ? "yes" : "no"),
+        (vertex_bytes * repeats) / vertex_seconds / 1e9, (index_bytes * repeats) / index_seconds / 1e9);
+    }
+  }
+
+  lod::lod_node::lod_node_free(tree);
+  return 0;
+}
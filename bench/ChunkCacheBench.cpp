@@ -0,0 +1,85 @@
+// contention stress test for the chunk cache.
+// hammers a sharded cache and a single-lock one from a growing number of threads, and prints throughput.
+// usage: ChunkCacheBench [ops per thread]
+
+#include "util/ShardedLRUCache.hpp"
+#include "terrain/ChunkIdentifier.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <random>
+#include <thread>
+#include <vector>
+
+using namespace terraingen;
+
+// stands in for a chunk - only the pointer gets copied around
+struct Payload {
+  size_t value;
+};
+
+template <size_t ShardCount>
+double RunBench(size_t thread_count, size_t ops_per_thread) {
+  typedef util::ShardedLRUCache<terrain::ChunkIdentifier, std::shared_ptr<Payload>, ShardCount> Cache;
+
+  // keys look like a real quadtree: power of two sizes, aligned to their size.
+  // a working set a bit bigger than the cache, so evictions happen too
+  const size_t capacity = 1024;
+  const long key_span = 48;
+  Cache cache(capacity);
+
+  auto worker = [&cache, ops_per_thread](size_t seed) {
+    std::mt19937 rng(static_cast<unsigned int>(seed));
+    std::uniform_int_distribution<long> coord(0, key_span - 1);
+    std::uniform_int_distribution<int> op(0, 9);
+    std::shared_ptr<Payload> payload = std::make_shared<Payload>(Payload { seed });
+    std::shared_ptr<Payload> output;
+    for (size_t i = 0; i < ops_per_thread; i++) {
+      terrain::ChunkIdentifier id { coord(rng) * 64, coord(rng) * 64, 64 };
+
+      // roughly what an update does: mostly lookups, some inserts
+      int kind = op(rng);
+      if (kind < 5) {
+        if (!cache.Fetch(id, &output)) {
+          cache.Put(id, payload);
+        }
+      } else if (kind < 8) {
+        cache.Peek(id, &output);
+      } else {
+        cache.Put(id, payload);
+      }
+    }
+  };
+
+  auto start = std::chrono::steady_clock::now();
+  std::vector<std::thread> threads;
+  for (size_t t = 0; t < thread_count; t++) {
+    threads.emplace_back(worker, t + 1);
+  }
+
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  return static_cast<double>(thread_count * ops_per_thread) / seconds;
+}
+
+int main(int argc, char** argv) {
+  size_t ops_per_thread = 1000000;
+  if (argc > 1) {
+    ops_per_thread = static_cast<size_t>(std::strtoull(argv[1], nullptr, 10));
+  }
+
+  std::printf("hardware threads: %u\n", std::thread::hardware_concurrency());
+  std::printf("%8s %16s %16s\n", "threads", "1 shard (op/s)", "16 shards (op/s)");
+  for (size_t threads : { 1, 2, 4, 8 }) {
+    double single = RunBench<1>(threads, ops_per_thread);
+    double sharded = RunBench<16>(threads, ops_per_thread);
+    std::printf("%8zu %16.0f %16.0f\n", threads, single, sharded);
+  }
+
+  return 0;
+}
@@ -0,0 +1,78 @@
+// leaf size lookups - the recursive tree walk against the flat morton index.
+// trees come from the lod generator, around a few positions, and points are random half-unit offsets like stitching uses.
+// usage: LeafLookupBench [lookups]
+
+#include "lod/LodTreeGenerator.hpp"
+#include "lod/lod_leaf_index.hpp"
+#include "lod/lod_node.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <random>
+#include <vector>
+
+using namespace terraingen;
+
+struct FlatSampler {
+  float Get(int x, int y) {
+    return 0.0f;
+  }
+};
+
+int main(int argc, char** argv) {
+  size_t lookups = 4000000;
+  if (argc > 1) {
+    lookups = static_cast<size_t>(std::strtoull(argv[1], nullptr, 10));
+  }
+
+  const size_t tree_res = 16384;
+  auto sampler = std::make_shared<FlatSampler>();
+  lod::LodTreeGenerator<FlatSampler> generator(sampler, tree_res, 64);
+  generator.cascade_factor = 256.0;
+
+  std::mt19937 rng(7);
+  std::uniform_int_distribution<long> coord(0, tree_res);
+  std::uniform_int_distribution<int> dir(0, 1);
+
+  std::printf("%10s %8s %14s %14s\n", "position", "leaves", "tree (ns/op)", "index (ns/op)");
+  for (float position : { 512.0f, 4096.0f, 8192.0f }) {
+    lod::lod_node* tree = generator.CreateLodTree(glm::vec3(position, 0.0f, position));
+    lod::lod_leaf_index index;
+    index.Build(tree, tree_res);
+
+    struct Query { long x; long y; int dir_x; int dir_y; };
+    std::vector<Query> queries(lookups);
+    for (Query& query : queries) {
+      query = { coord(rng), coord(rng), dir(rng) * 2 - 1, dir(rng) * 2 - 1 };
+    }
+
+    // sum the results, so nothing gets optimized out - and check they agree while we're at it
+    auto start = std::chrono::steady_clock::now();
+    size_t tree_sum = 0;
+    for (const Query& query : queries) {
+      tree_sum += lod::lod_node::GetChunkSize(tree, tree_res, glm::vec2(query.x + 0.5f * query.dir_x, query.y + 0.5f * query.dir_y));
+    }
+
+    double tree_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    start = std::chrono::steady_clock::now();
+    size_t index_sum = 0;
+    for (const Query& query : queries) {
+      index_sum += index.GetChunkSize(query.x, query.y, query.dir_x, query.dir_y);
+    }
+
+    double index_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (tree_sum != index_sum) {
+      std::printf("mismatch: %zu vs %zu\n", tree_sum, index_sum);
+      return 1;
+    }
+
+    std::printf("%10.0f %8zu %14.2f %14.2f\n", position, index.GetLeafCount(),
+      tree_seconds * 1e9 / lookups, index_seconds * 1e9 / lookups);
+    lod::lod_node::lod_node_free(tree);
+  }
+
+  return 0;
+}
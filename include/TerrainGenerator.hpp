@@ -5,16 +5,40 @@
 
 #include "terrain/ChunkGenerator.hpp"
 #include "lod/LodTreeGenerator.hpp"
+#include "lod/lod_height_pyramid.hpp"
+#include "lod/ScreenSpaceError.hpp"
+#include "terrain/PrefetchSettings.hpp"
+#include "util/Executor.hpp"
+#include "util/WorkStealingPool.hpp"
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <cstddef>
 #include <memory>
+#include <mutex>
+#include <vector>
 
 // if this is the way we go, then this should be the only public thing
 namespace terraingen {
-  template <typename HeightMap>
+  /**
+   * @brief Generates terrain around a moving point.
+   *
+   * @tparam HeightMap - format for height map
+   * @tparam Attributes - mask of terrain::VertexAttribute flags to compute and store.
+   *                      Vertex buffers are written as terrain::VertexFormat<Attributes>.
+   * @tparam ChunkRes - chunk resolution, if known at compile time. 0 reads it at runtime.
+   */
+  template <typename HeightMap, unsigned int Attributes = terrain::ALL_ATTRIBUTES, size_t ChunkRes = 0>
   class TerrainGenerator {
   static_assert(traits::height_map<HeightMap>::value);
   public:
+    // chunk store, safe to share between generators with matching settings
+    typedef typename terrain::ChunkGenerator<HeightMap, Attributes, ChunkRes>::ChunkCache ChunkCache;
+
+    // published chunk set, readable from any thread
+    typedef typename terrain::ChunkGenerator<HeightMap, Attributes, ChunkRes>::Snapshot Snapshot;
+
     TerrainGenerator(
       std::shared_ptr<HeightMap> heightmap,
       float horizontal_scale,
@@ -40,45 +64,577 @@ namespace terraingen {
         offset_(terrain_offset) {
           tree_gen_.cascade_factor = cascade_factor;
         }
+
+    ~TerrainGenerator() {
+      std::unique_lock<std::mutex> lock(async_lock_);
+      async_stop_ = true;
+      async_cancel_ = true;
+      async_cond_.wait(lock, [this] { return !async_running_; });
+    }
+
+    // background updates point at us
+    TerrainGenerator(const TerrainGenerator&) = delete;
+    TerrainGenerator& operator=(const TerrainGenerator&) = delete;
     
+    /**
+     * @brief Updates chunks around a new position, and publishes them right away.
+     *        Supersedes any background update, and cuts short one that's running.
+     * 
+     * @param local_position - position to generate around
+     */
     void UpdateChunkData(const glm::vec3& local_position) {
-      // update lod tree
-      lod::lod_node* tree = tree_gen_.CreateLodTree(local_position - offset_);
-      chunk_gen_.UpdateChunks(tree, terrain_res_);
-      lod::lod_node::lod_node_free(tree);
+      auto lock = LockIdle(true);
+      async_requested_ = false;
+      async_ready_ = false;
+      StageChunkData(local_position);
+      PublishStaged();
+    }
+
+    /**
+     * @brief Updates chunks around several observers at once, and publishes them right away.
+     *        Each observer gets its own view in our outputs. Chunks they have in common are built once.
+     *        Supersedes any background update, and cuts short one that's running.
+     * 
+     * @param local_positions - position of each observer, in view order
+     */
+    void UpdateChunkData(const std::vector<glm::vec3>& local_positions) {
+      auto lock = LockIdle(true);
+      async_requested_ = false;
+      async_ready_ = false;
+      StageChunkData(local_positions);
+      PublishStaged();
+    }
+
+    /**
+     * @brief Updates chunks around a new position, building only as many as fit in a budget, and publishes them right away.
+     *        Leaves which aren't ready yet are drawn with their nearest cached ancestor - keep calling to refine them.
+     *        Supersedes any background update, and cuts short one that's running.
+     * 
+     * @param local_position - position to generate around
+     * @param budget - limits on building. time is counted from when chunk building starts.
+     * @return true if every chunk is drawn at the resolution the position calls for
+     */
+    bool UpdateChunkData(const glm::vec3& local_position, const terrain::UpdateBudget& budget) {
+      auto lock = LockIdle(true);
+      async_requested_ = false;
+      async_ready_ = false;
+
+      StageChunkData(local_position, &budget);
+      PublishStaged();
+      return chunk_gen_.IsComplete();
+    }
+
+    /**
+     * @brief Starts updating chunks around a new position in the background, as a task on our executor.
+     *        Outputs keep reading the last published chunk set until PollChunkData or WaitChunkData publishes this one.
+     *        If an update is already running, it's cut short - chunks it finished are kept for the next one.
+     *        Only the latest requested position is kept.
+     *        Without an executor, updates run on a thread of our own.
+     * 
+     * @param local_position - position to generate around
+     */
+    void UpdateChunkDataAsync(const glm::vec3& local_position) {
+      std::unique_lock<std::mutex> lock(async_lock_);
+      async_positions_.assign(1, local_position);
+      async_predicted_ = false;
+      async_requested_ = true;
+      async_cancel_ = async_running_;
+      StartAsync(lock);
+    }
+
+    /**
+     * @brief Starts updating chunks around several observers in the background, one view each.
+     * 
+     * @param local_positions - position of each observer, in view order
+     */
+    void UpdateChunkDataAsync(const std::vector<glm::vec3>& local_positions) {
+      std::unique_lock<std::mutex> lock(async_lock_);
+      async_positions_ = local_positions;
+      async_predicted_ = false;
+      async_requested_ = true;
+      async_cancel_ = async_running_;
+      StartAsync(lock);
+    }
+
+    /**
+     * @brief Starts a background update, then prefetches chunks along the predicted path once it's staged.
+     *        Prefetching gives way to any newer request.
+     * 
+     * @param local_position - position to generate around
+     * @param velocity - current velocity of the observer
+     */
+    void UpdateChunkDataAsync(const glm::vec3& local_position, const glm::vec3& velocity) {
+      std::unique_lock<std::mutex> lock(async_lock_);
+      async_positions_.assign(1, local_position);
+      async_velocity_ = velocity;
+      async_predicted_ = true;
+      async_requested_ = true;
+      async_cancel_ = async_running_;
+      StartAsync(lock);
+    }
+
+    /**
+     * @brief Updates chunks around a new position and publishes them, then prefetches chunks along the predicted path.
+     * 
+     * @param local_position - position to generate around
+     * @param velocity - current velocity of the observer
+     */
+    void UpdateChunkData(const glm::vec3& local_position, const glm::vec3& velocity) {
+      auto lock = LockIdle(true);
+      async_requested_ = false;
+      async_ready_ = false;
+      StageChunkData(local_position);
+      PublishStaged();
+      PrefetchPath(PredictPath(local_position, velocity), nullptr);
+    }
+
+    /**
+     * @brief Builds chunks for positions we expect to visit, straight into the cache, within the prefetch budget.
+     *        Outputs are left alone.
+     * 
+     * @param path - predicted positions, soonest first
+     * @return size_t - number of chunks built
+     */
+    size_t PrefetchChunkData(const std::vector<glm::vec3>& path) {
+      auto lock = LockIdle();
+      return PrefetchPath(path, nullptr);
+    }
+
+    /**
+     * @brief Sets how far ahead velocity based updates look, and how much they may build.
+     * 
+     * @param settings - prefetch settings. an empty lookahead turns prediction off.
+     */
+    void SetPrefetchSettings(const terrain::PrefetchSettings& settings) {
+      auto lock = LockIdle();
+      prefetch_ = settings;
+    }
+
+    /**
+     * @brief Publishes the result of a background update, if one has finished. Call from the thread reading outputs.
+     * 
+     * @return true if a new chunk set was published
+     */
+    bool PollChunkData() {
+      std::unique_lock<std::mutex> lock(async_lock_);
+      bool published = PublishReady();
+      StartAsync(lock);
+      return published;
+    }
+
+    /**
+     * @brief Waits for every requested background update to finish, and publishes the last one.
+     */
+    void WaitChunkData() {
+      std::unique_lock<std::mutex> lock(async_lock_);
+      while (true) {
+        PublishReady();
+        StartAsync(lock);
+
+        // a prefetch doesn't hold us up, unless there's a request queued behind it
+        if (async_staging_ || (async_running_ && async_requested_)) {
+          async_cond_.wait(lock);
+        } else if (!async_ready_) {
+          break;
+        }
+      }
+    }
+
+    /**
+     * @brief Stores chunks in a cache shared with other generators, so overlapping terrain is only built once.
+     *        Everyone sharing a cache needs the same height map, scales, offset and chunk resolution.
+     * 
+     * @param cache - cache to use. null goes back to a private one.
+     */
+    void SetChunkCache(std::shared_ptr<ChunkCache> cache) {
+      auto lock = LockIdle();
+      chunk_gen_.SetChunkCache(std::move(cache));
+    }
+
+    /**
+     * @brief Sets the executor which runs chunk generation, background updates and buffer writes.
+     *        With more than one thread, the height map must be safe to sample from several threads at once.
+     * 
+     * @param executor - executor to submit work to. null (the default) builds chunks on the caller.
+     */
+    void SetExecutor(std::shared_ptr<util::Executor> executor) {
+      auto lock = LockIdle();
+      executor_ = executor;
+      chunk_gen_.SetExecutor(std::move(executor));
+    }
+
+    /**
+     * @brief Makes buffer writes use non-temporal stores - for writing straight into mapped gpu staging memory.
+     *        Slower into memory that's read back soon after.
+     * 
+     * @param streaming - true to stream writes
+     */
+    void SetStreamingWrites(bool streaming) {
+      auto lock = LockIdle();
+      chunk_gen_.SetStreamingWrites(streaming);
+    }
+
+    /**
+     * @brief Lets far chunks interpolate most of their heights from a sparse set of samples.
+     * 
+     * @param settings - approximation settings. min_chunk_size 0 turns it off.
+     */
+    void SetApproximateSampling(const terrain::ApproximateSampling& settings) {
+      auto lock = LockIdle();
+      chunk_gen_.SetApproximateSampling(settings);
     }
 
-    size_t GetChunkCount() {
-      return chunk_gen_.GetChunkCount();
+    /**
+     * @brief Picks LOD by how large each node's height error would look on screen, rather than by distance alone.
+     * 
+     * @param settings - projection settings. viewport_height 0 turns it off.
+     */
+    void SetScreenSpaceError(const lod::ScreenSpaceError& settings) {
+      auto lock = LockIdle(true);
+      tree_gen_.SetScreenSpaceError(settings);
     }
 
-    size_t GetVertexBufferSize() {
-      return chunk_gen_.GetVertexBufferSize();
+    /**
+     * @brief Picks LOD by distance to each node's full 3D bounds, so terrain far above or below us counts as further away.
+     *        Bounds are estimated from a chunk's worth of samples per node, so very narrow peaks can be missed - see LodTreeGenerator.
+     * 
+     * @param enabled - true to use height bounds
+     */
+    void SetHeightBounds(bool enabled) {
+      auto lock = LockIdle(true);
+      tree_gen_.SetHeightBounds(enabled);
     }
 
-    size_t GetIndexBufferSize() {
-      return chunk_gen_.GetIndexBufferSize();
+    /**
+     * @return std::shared_ptr<lod::lod_height_pyramid<HeightMap>> - min/max heights and roughness for every tree node,
+     *         in height map units. Measured on first use, and safe to query from any thread, ie for culling.
+     */
+    std::shared_ptr<lod::lod_height_pyramid<HeightMap>> GetHeightPyramid() const {
+      return tree_gen_.GetHeightPyramid();
     }
 
-    void WriteVertexBuffer(void* dst, size_t n) {
-      return chunk_gen_.WriteVertexBuffer(dst, n);
+    /**
+     * @brief Runs everything on a work stealing pool of our own.
+     *        Above 1, the height map must be safe to sample from several threads at once.
+     * 
+     * @param threads - number of threads, counting the caller
+     */
+    void SetThreadCount(size_t threads) {
+      SetExecutor(threads > 1 ? std::make_shared<util::WorkStealingPool>(threads - 1) : nullptr);
     }
 
-    size_t WriteVertexBufferSeparate(glm::vec3* positions, glm::vec3* normals, glm::vec2* texcoords, glm::vec4* tangents, const size_t vertices) {
-      return chunk_gen_.WriteVertexBufferSeparate(positions, normals, texcoords, tangents, vertices);
+    /**
+     * @brief Grabs the published chunk set. Render and upload threads can read it without locking,
+     *        while updates build the next one. Chunks it draws stay alive until the last copy is dropped.
+     * 
+     * @return std::shared_ptr<const Snapshot> - the published chunk set. never null
+     */
+    std::shared_ptr<const Snapshot> GetSnapshot() const {
+      return chunk_gen_.GetSnapshot();
     }
 
-    size_t WriteIndexBuffer(void* dst, size_t n) {
-      return chunk_gen_.WriteIndexBuffer(dst, n);
+    // outputs read one view at a time - one per observer, in the order they were passed in.
+    // single position updates only fill view 0.
+    // each call reads the latest snapshot - off the updating thread, hold one from GetSnapshot instead
+
+    size_t GetViewCount() {
+      return chunk_gen_.GetViewCount();
+    }
+
+    size_t GetChunkCount(size_t view = 0) {
+      return chunk_gen_.GetChunkCount(view);
+    }
+
+    size_t GetVertexBufferSize(size_t view = 0) {
+      return chunk_gen_.GetVertexBufferSize(view);
+    }
+
+    size_t GetIndexBufferSize(size_t view = 0) {
+      return chunk_gen_.GetIndexBufferSize(view);
+    }
+
+    size_t WriteVertexBuffer(void* dst, size_t n, size_t view = 0) {
+      return chunk_gen_.WriteVertexBuffer(dst, n, view);
+    }
+
+    size_t WriteVertexBufferSeparate(glm::vec3* positions, glm::vec3* normals, glm::vec2* texcoords, glm::vec4* tangents, const size_t vertices, size_t view = 0) {
+      return chunk_gen_.WriteVertexBufferSeparate(positions, normals, texcoords, tangents, vertices, view);
+    }
+
+    size_t WriteIndexBuffer(void* dst, size_t n, size_t view = 0) {
+      return chunk_gen_.WriteIndexBuffer(dst, n, view);
     }
 
   private:
+    // builds chunks for a position, without publishing them.
+    // false if cancelled, or if our outputs already show everything the position calls for
+    bool StageChunkData(const glm::vec3& local_position, const terrain::UpdateBudget* budget, const std::atomic<bool>* cancel = nullptr) {
+      const glm::vec3 tree_position = GetTreePosition(local_position);
+      const lod::lod_node* tree = tree_gen_.UpdateLodTree(tree_position, &tree_diff_);
+      if (!tree_diff_.Empty() || !view_trees_.empty()) {
+        // moved, or the last update drew several views
+        tree_version_++;
+        view_trees_.clear();
+      }
+
+      // usually we haven't moved far enough to change a single leaf
+      if (published_version_ == tree_version_ && chunk_gen_.IsComplete() && !chunk_gen_.HasStagedChunks()) {
+        return false;
+      }
+
+      bool staged = (budget != nullptr
+        ? chunk_gen_.StageChunks(tree, terrain_res_, tree_position, *budget, cancel)
+        : chunk_gen_.StageChunks(tree, terrain_res_, tree_position, cancel));
+      staged_version_ = (staged ? tree_version_ : 0);
+      return staged;
+    }
+
+    bool StageChunkData(const glm::vec3& local_position, const std::atomic<bool>* cancel = nullptr) {
+      return StageChunkData(local_position, nullptr, cancel);
+    }
+
+    // builds chunks for several positions, one view each
+    bool StageChunkData(const std::vector<glm::vec3>& local_positions, const std::atomic<bool>* cancel = nullptr) {
+      if (local_positions.size() == 1) {
+        return StageChunkData(local_positions.front(), cancel);
+      }
+
+      // every tree shares an arena. the last set stays in the other one, to compare against
+      view_arena_ ^= 1;
+      view_arenas_[view_arena_].Reset();
+      std::vector<const lod::lod_node*> trees;
+      std::vector<glm::vec3> tree_positions;
+      bool changed = (local_positions.size() != view_trees_.size());
+      for (size_t view = 0; view < local_positions.size(); view++) {
+        tree_positions.push_back(GetTreePosition(local_positions[view]));
+        trees.push_back(tree_gen_.CreateLodTree(tree_positions.back(), &view_arenas_[view_arena_]));
+        changed = (changed || !SameShape(trees.back(), view_trees_[view]));
+      }
+
+      view_trees_ = trees;
+      if (changed) {
+        tree_version_++;
+      }
+
+      // same check as a single position - nobody moved far enough to change a leaf
+      if (published_version_ == tree_version_ && chunk_gen_.IsComplete() && !chunk_gen_.HasStagedChunks()) {
+        return false;
+      }
+
+      bool staged = chunk_gen_.StageChunks(trees, terrain_res_, tree_positions, cancel);
+      staged_version_ = (staged ? tree_version_ : 0);
+      return staged;
+    }
+
+    std::vector<glm::vec3> PredictPath(const glm::vec3& local_position, const glm::vec3& velocity) const {
+      std::vector<glm::vec3> path;
+      for (float time : prefetch_.lookahead) {
+        path.push_back(local_position + velocity * time);
+      }
+
+      return path;
+    }
+
+    // prefetches each position in turn, until the budget runs out
+    size_t PrefetchPath(const std::vector<glm::vec3>& path, const std::atomic<bool>* cancel) {
+      const auto start = std::chrono::steady_clock::now();
+      size_t built = 0;
+      for (const glm::vec3& position : path) {
+        terrain::UpdateBudget budget = prefetch_.budget;
+        if (budget.max_chunks > 0) {
+          if (built >= budget.max_chunks) {
+            break;
+          }
+
+          budget.max_chunks -= built;
+        }
+
+        if (budget.milliseconds > 0.0) {
+          budget.milliseconds -= std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+          if (budget.milliseconds <= 0.0) {
+            break;
+          }
+        }
+
+        if (cancel != nullptr && cancel->load()) {
+          break;
+        }
+
+        const glm::vec3 tree_position = GetTreePosition(position);
+        tree_arena_.Reset();
+        lod::lod_node* tree = tree_gen_.CreateLodTree(tree_position, &tree_arena_);
+        built += chunk_gen_.PrefetchChunks(tree, terrain_res_, tree_position, budget, cancel);
+      }
+
+      return built;
+    }
+
+    // where a position lands in the tree. height is in height map units, same as the pyramid:
+    // vertices sit at their sample minus offset.y, so their samples are at y + offset.y
+    glm::vec3 GetTreePosition(const glm::vec3& local_position) const {
+      glm::vec3 res = local_position - offset_;
+      res.y = local_position.y + offset_.y;
+      return res;
+    }
+
+    // true if two trees are split the same way
+    static bool SameShape(const lod::lod_node* a, const lod::lod_node* b) {
+      if (a->tl == nullptr || b->tl == nullptr) {
+        return (a->tl == b->tl);
+      }
+
+      return (SameShape(a->bl, b->bl) && SameShape(a->br, b->br) && SameShape(a->tl, b->tl) && SameShape(a->tr, b->tr));
+    }
+
+    // locks out background updates, once any in flight are done.
+    // cancel cuts short a running update, and drops any request queued behind it - otherwise the update would go on to build that
+    std::unique_lock<std::mutex> LockIdle(bool cancel = false) {
+      std::unique_lock<std::mutex> lock(async_lock_);
+      if (cancel) {
+        async_requested_ = false;
+        if (async_running_) {
+          async_cancel_ = true;
+        }
+      }
+
+      async_cond_.wait(lock, [this] { return !async_running_; });
+      return lock;
+    }
+
+    // submits a background update if one is wanted, and none is in flight.
+    // submitting drops the lock - an inline executor runs the update right here
+    void StartAsync(std::unique_lock<std::mutex>& lock) {
+      if (async_stop_ || async_running_ || async_ready_ || !async_requested_) {
+        return;
+      }
+
+      if (!executor_ && !async_pool_) {
+        async_pool_ = std::make_shared<util::WorkStealingPool>(1);
+      }
+
+      util::Executor& executor = (executor_ ? *executor_ : *async_pool_);
+      async_running_ = true;
+      lock.unlock();
+      executor.Submit([this] { RunAsync(); });
+      lock.lock();
+    }
+
+    // publishes whatever's staged. call with async_lock_ held, or locked idle
+    bool PublishStaged() {
+      if (!chunk_gen_.PublishChunks()) {
+        return false;
+      }
+
+      published_version_ = staged_version_;
+      return true;
+    }
+
+    // call with async_lock_ held
+    bool PublishReady() {
+      if (!async_ready_) {
+        return false;
+      }
+
+      PublishStaged();
+      async_ready_ = false;
+
+      return true;
+    }
+
+    // background update for the latest position. the next one is started once this one is published.
+    // if a newer position comes in while we're building, we drop this one and start over
+    void RunAsync() {
+      std::unique_lock<std::mutex> lock(async_lock_);
+      while (!async_stop_ && async_requested_ && !async_ready_) {
+        std::vector<glm::vec3> positions = async_positions_;
+        glm::vec3 velocity = async_velocity_;
+        bool predicted = async_predicted_;
+        async_requested_ = false;
+        async_cancel_ = false;
+        async_staging_ = true;
+
+        lock.unlock();
+        bool staged = StageChunkData(positions, &async_cancel_);
+        lock.lock();
+
+        async_staging_ = false;
+        async_ready_ = staged;
+
+        // nothing staged and not cancelled means we were already up to date - still worth looking ahead
+        if (predicted && (staged || !async_cancel_.load())) {
+          // let the reader publish while we look ahead
+          async_cond_.notify_all();
+          std::vector<glm::vec3> path = PredictPath(positions.front(), velocity);
+
+          lock.unlock();
+          PrefetchPath(path, &async_cancel_);
+          lock.lock();
+        }
+      }
+
+      async_running_ = false;
+      async_cond_.notify_all();
+    }
+
     std::shared_ptr<HeightMap> heightmap_;
-    terrain::ChunkGenerator<HeightMap> chunk_gen_;
+    terrain::ChunkGenerator<HeightMap, Attributes, ChunkRes> chunk_gen_;
     lod::LodTreeGenerator<HeightMap> tree_gen_;
+
+    // tree for single position updates, kept between them so small moves can skip building altogether.
+    // versions tell us which tree a chunk set came from - 0 for anything else
+    lod::lod_tree_diff tree_diff_;
+    size_t tree_version_ = 0;
+    size_t staged_version_ = 0;
+    size_t published_version_ = 0;
+
+    // nodes for prefetch trees. only touched with the generator locked idle,
+    // or from the one background update running
+    lod::lod_arena tree_arena_;
+
+    // nodes for multi-view trees, same rules. the last set we built stays around in one arena while we build the next in the other.
+    // view_trees_ is empty if the last update had a single position
+    lod::lod_arena view_arenas_[2];
+    size_t view_arena_ = 0;
+    std::vector<const lod::lod_node*> view_trees_;
     size_t terrain_res_;
     glm::vec3 offset_;
+    terrain::PrefetchSettings prefetch_;
+
+    // null if nobody gave us one
+    std::shared_ptr<util::Executor> executor_;
+
+    // runs background updates when we don't have an executor
+    std::shared_ptr<util::Executor> async_pool_;
+
+    // background updates
+    std::mutex async_lock_;
+    std::condition_variable async_cond_;
+    std::vector<glm::vec3> async_positions_;
+
+    // a position is waiting to be picked up
+    bool async_requested_ = false;
+
+    // prefetch along velocity once the update is staged
+    glm::vec3 async_velocity_;
+    bool async_predicted_ = false;
+
+    // an update is submitted, and hasn't finished yet
+    bool async_running_ = false;
+
+    // that update is still building the chunks it'll publish
+    bool async_staging_ = false;
+
+    // tells a running update its position is stale
+    std::atomic<bool> async_cancel_ { false };
+
+    // staged chunks are waiting to be published
+    bool async_ready_ = false;
+    bool async_stop_ = false;
   };
+
+  // chunk resolution baked in - chunk_res passed to the constructor must match, or it throws std::invalid_argument
+  template <typename HeightMap, size_t ChunkRes, unsigned int Attributes = terrain::ALL_ATTRIBUTES>
+  using StaticTerrainGenerator = TerrainGenerator<HeightMap, Attributes, ChunkRes>;
 }
 
 #endif // TERRAIN_GENERATOR_H_
\ No newline at end of file
@@ -3,13 +3,22 @@
 
 #define CASCADE_MUL_FACTOR 4
 
+#include "lod/lod_arena.hpp"
+#include "lod/lod_height_pyramid.hpp"
 #include "lod/lod_node.hpp"
+#include "lod/lod_tree_diff.hpp"
+#include "lod/ScreenSpaceError.hpp"
 
 #include <glm/glm.hpp>
 
 #include "traits/height_map.hpp"
 
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <limits>
 #include <memory>
+#include <vector>
 
 namespace terraingen {
   namespace lod {
@@ -23,7 +32,8 @@ namespace terraingen {
       LodTreeGenerator(std::shared_ptr<HeightMap> height_map, int size, int chunk_res)
        : height_map_(height_map),
          size_(size),
-         chunk_res_(chunk_res)
+         chunk_res_(chunk_res),
+         pyramid_(std::make_shared<lod_height_pyramid<HeightMap>>(height_map, size, chunk_res))
       {
         // PoT + 1
         assert(((size) & (size - 1)) == 0);
@@ -34,38 +44,151 @@ namespace terraingen {
 
 
 
+      // allocates each node on its own - free with lod_node_free
       lod_node* CreateLodTree(const glm::vec3& local_position);
 
+      /**
+       * @brief Builds the tree out of an arena instead. Valid until the arena is reset.
+       * 
+       * @param local_position - position to build the tree around
+       * @param arena - where nodes come from
+       * @return lod_node* - root node
+       */
+      lod_node* CreateLodTree(const glm::vec3& local_position, lod_arena* arena);
+
+      /**
+       * @brief Moves the tree we keep to a new position, and reports which leaves changed.
+       *        Only parts of the tree whose split decisions could have changed since they were last checked are revisited,
+       *        so small moves cost next to nothing. The result matches CreateLodTree at the same position.
+       * 
+       * @param local_position - position to build the tree around
+       * @param diff - receives leaves added and removed since the last call. may be null
+       * @return const lod_node* - root of the kept tree. valid until the next call to UpdateLodTree or ResetLodTree
+       */
+      const lod_node* UpdateLodTree(const glm::vec3& local_position, lod_tree_diff* diff = nullptr);
+
+      // drops the kept tree. the next UpdateLodTree starts over, and reports every leaf as added
+      void ResetLodTree();
+
+      /**
+       * @brief Splits nodes by how large their height error would look on screen, rather than by distance alone.
+       *        Flat ground stays coarse up close, and rough ground refines further out. Drops the kept tree.
+       * 
+       * @param settings - projection settings. viewport_height 0 turns it off.
+       */
+      void SetScreenSpaceError(const ScreenSpaceError& settings) {
+        sse_ = settings;
+        ResetLodTree();
+      }
+
+      /**
+       * @brief Measures distance to each node's full 3D bounds, rather than to its footprint at our own height.
+       *        Heights come from the pyramid, which measures each node from a chunk's worth of samples as the tree reaches it.
+       *        They're estimates, not exact bounds: a feature narrower than a node's sample spacing, like a lone spike, can stick out of them.
+       *        Near one, a node then counts as further away than it is, and stays coarser than it should. Drops the kept tree.
+       * 
+       * @param enabled - true to use height bounds
+       */
+      void SetHeightBounds(bool enabled) {
+        height_bounds_ = enabled;
+        ResetLodTree();
+      }
+
+      /**
+       * @return std::shared_ptr<lod_height_pyramid<HeightMap>> - min/max heights and roughness for our nodes.
+       *         Filled in as the tree asks for them, and free for anything else to query, ie for culling.
+       */
+      std::shared_ptr<lod_height_pyramid<HeightMap>> GetHeightPyramid() const {
+        return pyramid_;
+      }
+
       // distance cap for min subdivision level
       // other cascades are handled internally
       double cascade_factor;
 
       // max number of chunk subdivisions to perform
     private:
+      // children of a kept node, plus when we last checked them
+      struct tracked_quad {
+        // bl, br, tl, tr - same order as a node's pointers
+        lod_node children[4];
+
+        // position we last checked these children from
+        glm::vec3 anchor;
+
+        // distance from anchor we can go before any split decision below here might change
+        double slack;
+      };
+
       const std::shared_ptr<HeightMap> height_map_;
       const int size_;
       const int chunk_res_;
 
-      void CreateLodTree_recurse(int x, int y, int node_size, double cascade_threshold, const glm::vec3& local_position, lod_node* root);
+      // the kept tree
+      lod_node kept_root_ {};
+      bool kept_ = false;
+      double kept_cascade_ = 0.0;
+      glm::vec3 root_anchor_;
+      double root_slack_ = 0.0;
+
+      // storage for kept nodes - freed quads are reused before anything new is allocated
+      std::vector<std::unique_ptr<tracked_quad[]>> quad_blocks_;
+      std::vector<tracked_quad*> free_quads_;
+
+      ScreenSpaceError sse_;
+      bool height_bounds_ = false;
+
+      // node errors and bounds, measured once and kept
+      const std::shared_ptr<lod_height_pyramid<HeightMap>> pyramid_;
+
+      void CreateLodTree_recurse(int x, int y, int node_size, double cascade_threshold, const glm::vec3& local_position, lod_node* root, lod_arena* arena);
+
+      double GetRootThreshold() const;
+
+      // how far we've gone since a split decision was made. slack is measured the same way
+      double GetMoved(const glm::vec3& local_position, const glm::vec3& anchor) const {
+        if (height_bounds_) {
+          return glm::length(local_position - anchor);
+        }
+
+        // footprints span every height
+        return glm::length(glm::vec2(local_position.x - anchor.x, local_position.z - anchor.z));
+      }
+
+      // true if a node should split. slack receives how far we are from that changing
+      bool ShouldSplit(int x, int y, int node_size, double cascade_threshold, const glm::vec3& local_position, double* slack) const;
+
+      // splits a leaf of the kept tree as far as it needs to go. returns slack for the subtree
+      double GrowKept_recurse(int x, int y, int node_size, double cascade_threshold, const glm::vec3& local_position, lod_node* node, lod_tree_diff* diff);
+
+      // rechecks a node of the kept tree, and anything below it that might have changed. returns slack for the subtree
+      double UpdateKept_recurse(int x, int y, int node_size, double cascade_threshold, const glm::vec3& local_position, lod_node* node, lod_tree_diff* diff);
+
+      // frees everything below a node of the kept tree, leaving it a leaf
+      void CollapseKept_recurse(int x, int y, int node_size, lod_node* node, lod_tree_diff* diff);
+
+      tracked_quad* GetQuad(const lod_node* node) const {
+        // children are the first thing in their quad
+        return reinterpret_cast<tracked_quad*>(node->bl);
+      }
     };
 
     template <typename HeightMap>
     lod_node* LodTreeGenerator<HeightMap>::CreateLodTree(const glm::vec3& local_position) {
-      auto* node = lod_node::lod_node_alloc();
-      int size = size_;
-      double cascade_real = cascade_factor / CASCADE_MUL_FACTOR;
-      while (size > chunk_res_) {
-        cascade_real *= CASCADE_MUL_FACTOR;
-        size >>= 1;
-      }
+      return CreateLodTree(local_position, nullptr);
+    }
 
+    template <typename HeightMap>
+    lod_node* LodTreeGenerator<HeightMap>::CreateLodTree(const glm::vec3& local_position, lod_arena* arena) {
+      auto* node = (arena != nullptr ? arena->Alloc() : lod_node::lod_node_alloc());
       CreateLodTree_recurse(
         0,
         0,
         size_,
-        cascade_real,
+        GetRootThreshold(),
         local_position,
-        node
+        node,
+        arena
       );
 
       return node;
@@ -78,43 +201,265 @@ namespace terraingen {
       int node_size,
       double cascade_threshold,
       const glm::vec3& local_position,
-      lod_node* root) 
+      lod_node* root,
+      lod_arena* arena) 
+    {
+      double slack;
+      if (!ShouldSplit(x, y, node_size, cascade_threshold, local_position, &slack)) {
+        return;
+      }
+
+      if (arena != nullptr) {
+        arena->AllocChildren(root);
+      } else {
+        root->bl = lod_node::lod_node_alloc();
+        root->br = lod_node::lod_node_alloc();
+        root->tl = lod_node::lod_node_alloc();
+        root->tr = lod_node::lod_node_alloc();
+      }
+
+      double new_cascade_threshold = cascade_threshold / CASCADE_MUL_FACTOR;
+      int new_node_size = node_size / 2;
+
+      CreateLodTree_recurse(x,                 y,                 new_node_size, new_cascade_threshold, local_position, root->bl, arena);
+      CreateLodTree_recurse(x + new_node_size, y,                 new_node_size, new_cascade_threshold, local_position, root->br, arena);
+      CreateLodTree_recurse(x,                 y + new_node_size, new_node_size, new_cascade_threshold, local_position, root->tl, arena);
+      CreateLodTree_recurse(x + new_node_size, y + new_node_size, new_node_size, new_cascade_threshold, local_position, root->tr, arena);
+    }
+
+    template <typename HeightMap>
+    double LodTreeGenerator<HeightMap>::GetRootThreshold() const {
+      int size = size_;
+      double cascade_real = cascade_factor / CASCADE_MUL_FACTOR;
+      while (size > chunk_res_) {
+        cascade_real *= CASCADE_MUL_FACTOR;
+        size >>= 1;
+      }
+
+      return cascade_real;
+    }
+
+    template <typename HeightMap>
+    bool LodTreeGenerator<HeightMap>::ShouldSplit(
+      int x,
+      int y,
+      int node_size,
+      double cascade_threshold,
+      const glm::vec3& local_position,
+      double* slack) const
     {
       // no longer descend
       if (node_size <= chunk_res_) {
-        return;
+        *slack = std::numeric_limits<double>::infinity();
+        return false;
       }
 
+      if (sse_.viewport_height > 0.0) {
+        // error shrinks with distance - split while it'd still look bigger than max_pixels
+        const double error = pyramid_->GetError(x, y, node_size);
+        if (error <= 0.0) {
+          // drawn exactly at this level, no matter how close we get
+          *slack = std::numeric_limits<double>::infinity();
+          return false;
+        }
 
-      float dist_to_chunk;
-      float x_f = static_cast<float>(x);
-      float y_f = static_cast<float>(y);
+        const double pixels_per_unit = sse_.viewport_height / (2.0 * std::tan(sse_.fov * 0.5));
+        cascade_threshold = error * pixels_per_unit / sse_.max_pixels;
+      }
 
-      // side note: we need to map z to height :(
-      if (local_position.x < x || local_position.x > x + node_size || local_position.z < y || local_position.z > y + node_size) {
-        glm::vec3 closest_point(glm::clamp(local_position.x, x_f, x_f + node_size), local_position.y, glm::clamp(local_position.z, y_f, y_f + node_size));
-        dist_to_chunk = glm::length(closest_point - local_position);
-      } else {
-        // ignore z
-        dist_to_chunk = 0.0;
+      const float x_f = static_cast<float>(x);
+      const float y_f = static_cast<float>(y);
+
+      // tree x/y map to local x/z. without bounds, the node spans whatever height we're at
+      float closest_height = local_position.y;
+      if (height_bounds_) {
+        const lod_height_bounds bounds = pyramid_->GetLevelBounds(x, y, node_size);
+        closest_height = glm::clamp(local_position.y, bounds.min, bounds.max);
       }
 
-      if (dist_to_chunk > cascade_threshold) {
-        return;
+      glm::vec3 closest_point(glm::clamp(local_position.x, x_f, x_f + node_size), closest_height, glm::clamp(local_position.z, y_f, y_f + node_size));
+      const float dist_to_chunk = glm::length(closest_point - local_position);
+
+      // distance only changes as fast as we move, so the decision holds until we've covered the gap.
+      // knock a little off, for rounding in the distance
+      double gap = std::abs(dist_to_chunk - cascade_threshold);
+      *slack = std::max(gap - (1e-3 + 1e-5 * (dist_to_chunk + cascade_threshold)), 0.0);
+      return (dist_to_chunk <= cascade_threshold);
+    }
+
+    template <typename HeightMap>
+    const lod_node* LodTreeGenerator<HeightMap>::UpdateLodTree(const glm::vec3& local_position, lod_tree_diff* diff) {
+      if (diff != nullptr) {
+        diff->Clear();
       }
 
-      root->bl = lod_node::lod_node_alloc();
-      root->br = lod_node::lod_node_alloc();
-      root->tl = lod_node::lod_node_alloc();
-      root->tr = lod_node::lod_node_alloc();
+      const double threshold = GetRootThreshold();
+      if (kept_ && kept_cascade_ != cascade_factor) {
+        // every threshold moved - start over
+        CollapseKept_recurse(0, 0, size_, &kept_root_, diff);
+        kept_ = false;
+      }
 
-      double new_cascade_threshold = cascade_threshold / CASCADE_MUL_FACTOR;
-      int new_node_size = node_size / 2;
+      if (!kept_) {
+        kept_root_ = lod_node();
+        root_slack_ = GrowKept_recurse(0, 0, size_, threshold, local_position, &kept_root_, diff);
+        root_anchor_ = local_position;
+        kept_cascade_ = cascade_factor;
+        kept_ = true;
+        return &kept_root_;
+      }
+
+      // most frames end here
+      if (GetMoved(local_position, root_anchor_) < root_slack_) {
+        return &kept_root_;
+      }
+
+      root_slack_ = UpdateKept_recurse(0, 0, size_, threshold, local_position, &kept_root_, diff);
+      root_anchor_ = local_position;
+      return &kept_root_;
+    }
+
+    template <typename HeightMap>
+    void LodTreeGenerator<HeightMap>::ResetLodTree() {
+      if (kept_) {
+        CollapseKept_recurse(0, 0, size_, &kept_root_, nullptr);
+        kept_ = false;
+      }
+    }
+
+    template <typename HeightMap>
+    double LodTreeGenerator<HeightMap>::GrowKept_recurse(
+      int x,
+      int y,
+      int node_size,
+      double cascade_threshold,
+      const glm::vec3& local_position,
+      lod_node* node,
+      lod_tree_diff* diff)
+    {
+      double slack;
+      if (!ShouldSplit(x, y, node_size, cascade_threshold, local_position, &slack)) {
+        if (diff != nullptr) {
+          diff->added.push_back({ x, y, static_cast<size_t>(node_size) });
+        }
+
+        return slack;
+      }
+
+      if (free_quads_.empty()) {
+        const size_t block_size = 64;
+        quad_blocks_.emplace_back(new tracked_quad[block_size]);
+        for (size_t i = 0; i < block_size; i++) {
+          free_quads_.push_back(&quad_blocks_.back()[i]);
+        }
+      }
+
+      tracked_quad* quad = free_quads_.back();
+      free_quads_.pop_back();
+      node->bl = &quad->children[0];
+      node->br = &quad->children[1];
+      node->tl = &quad->children[2];
+      node->tr = &quad->children[3];
+
+      double child_slack = std::numeric_limits<double>::infinity();
+      int half_size = node_size / 2;
+      for (int i = 0; i < 4; i++) {
+        quad->children[i] = lod_node();
+        child_slack = std::min(child_slack, GrowKept_recurse(
+          x + (i & 1) * half_size,
+          y + (i >> 1) * half_size,
+          half_size,
+          cascade_threshold / CASCADE_MUL_FACTOR,
+          local_position,
+          &quad->children[i],
+          diff
+        ));
+      }
+
+      quad->anchor = local_position;
+      quad->slack = child_slack;
+      return std::min(slack, child_slack);
+    }
+
+    template <typename HeightMap>
+    double LodTreeGenerator<HeightMap>::UpdateKept_recurse(
+      int x,
+      int y,
+      int node_size,
+      double cascade_threshold,
+      const glm::vec3& local_position,
+      lod_node* node,
+      lod_tree_diff* diff)
+    {
+      double slack;
+      const bool split = ShouldSplit(x, y, node_size, cascade_threshold, local_position, &slack);
+      if (node->bl == nullptr) {
+        if (!split) {
+          return slack;
+        }
+
+        // leaf splits - it goes, its new leaves come in
+        if (diff != nullptr) {
+          diff->removed.push_back({ x, y, static_cast<size_t>(node_size) });
+        }
+
+        return GrowKept_recurse(x, y, node_size, cascade_threshold, local_position, node, diff);
+      }
+
+      if (!split) {
+        // merges back into a leaf
+        CollapseKept_recurse(x, y, node_size, node, diff);
+        if (diff != nullptr) {
+          diff->added.push_back({ x, y, static_cast<size_t>(node_size) });
+        }
+
+        return slack;
+      }
+
+      tracked_quad* quad = GetQuad(node);
+      double moved = GetMoved(local_position, quad->anchor);
+      if (moved < quad->slack) {
+        // nothing below here can have changed
+        return std::min(slack, quad->slack - moved);
+      }
+
+      double child_slack = std::numeric_limits<double>::infinity();
+      int half_size = node_size / 2;
+      for (int i = 0; i < 4; i++) {
+        child_slack = std::min(child_slack, UpdateKept_recurse(
+          x + (i & 1) * half_size,
+          y + (i >> 1) * half_size,
+          half_size,
+          cascade_threshold / CASCADE_MUL_FACTOR,
+          local_position,
+          &quad->children[i],
+          diff
+        ));
+      }
+
+      quad->anchor = local_position;
+      quad->slack = child_slack;
+      return std::min(slack, child_slack);
+    }
+
+    template <typename HeightMap>
+    void LodTreeGenerator<HeightMap>::CollapseKept_recurse(int x, int y, int node_size, lod_node* node, lod_tree_diff* diff) {
+      if (node->bl == nullptr) {
+        if (diff != nullptr) {
+          diff->removed.push_back({ x, y, static_cast<size_t>(node_size) });
+        }
+
+        return;
+      }
+
+      tracked_quad* quad = GetQuad(node);
+      int half_size = node_size / 2;
+      for (int i = 0; i < 4; i++) {
+        CollapseKept_recurse(x + (i & 1) * half_size, y + (i >> 1) * half_size, half_size, &quad->children[i], diff);
+      }
 
-      CreateLodTree_recurse(x,                 y,                 new_node_size, new_cascade_threshold, local_position, root->bl);
-      CreateLodTree_recurse(x + new_node_size, y,                 new_node_size, new_cascade_threshold, local_position, root->br);
-      CreateLodTree_recurse(x,                 y + new_node_size, new_node_size, new_cascade_threshold, local_position, root->tl);
-      CreateLodTree_recurse(x + new_node_size, y + new_node_size, new_node_size, new_cascade_threshold, local_position, root->tr);
+      free_quads_.push_back(quad);
+      *node = lod_node();
     }
   }
 }
@@ -0,0 +1,24 @@
+#ifndef SCREEN_SPACE_ERROR_H_
+#define SCREEN_SPACE_ERROR_H_
+
+namespace terraingen {
+  namespace lod {
+    /**
+     * @brief Settings for splitting nodes by how far off they'd look on screen, instead of by distance alone.
+     *        A node's error is how far its heights stray from what a coarser mesh would show -
+     *        flat ground stays coarse up close, rough ground refines further out.
+     */
+    struct ScreenSpaceError {
+      // vertical field of view, in radians
+      double fov = 1.0;
+
+      // height of the viewport, in pixels. 0 turns the metric off, and we split on distance alone.
+      double viewport_height = 0.0;
+
+      // nodes whose error would show up larger than this many pixels get split
+      double max_pixels = 1.0;
+    };
+  }
+}
+
+#endif // SCREEN_SPACE_ERROR_H_
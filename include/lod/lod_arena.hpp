@@ -0,0 +1,60 @@
+#ifndef LOD_ARENA_H_
+#define LOD_ARENA_H_
+
+#include "lod/lod_node.hpp"
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+namespace terraingen {
+  namespace lod {
+    /**
+     * @brief Reusable storage for lod trees. Nodes are handed out from big blocks,
+     *        and every node's children sit side by side, in the same order as its pointers.
+     *        Reset hands everything back at once - blocks are kept, so a tree no bigger than
+     *        one we've built before costs no allocations at all.
+     *        Nodes from an arena must not be passed to lod_node_free.
+     */
+    class lod_arena {
+    public:
+      /**
+       * @param block_size - nodes per block. rounded up to a multiple of 4
+       */
+      explicit lod_arena(size_t block_size = 1024);
+
+      lod_arena(const lod_arena&) = delete;
+      lod_arena& operator=(const lod_arena&) = delete;
+
+      // allocate a single node, with no children
+      lod_node* Alloc();
+
+      /**
+       * @brief allocates four children for a node, next to each other, and links them in.
+       * 
+       * @param parent - node to split
+       */
+      void AllocChildren(lod_node* parent);
+
+      // frees every node at once. anything handed out before is invalid after this
+      void Reset();
+
+      // nodes handed out since the last reset
+      size_t GetNodeCount() const;
+
+    private:
+      lod_node* Take(size_t count);
+
+      std::vector<std::unique_ptr<lod_node[]>> blocks_;
+      size_t block_size_;
+
+      // block we're handing nodes out of, and how far into it we are
+      size_t block_;
+      size_t used_;
+
+      size_t node_count_;
+    };
+  }
+}
+
+#endif // LOD_ARENA_H_
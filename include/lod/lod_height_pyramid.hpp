@@ -0,0 +1,302 @@
+#ifndef LOD_HEIGHT_PYRAMID_H_
+#define LOD_HEIGHT_PYRAMID_H_
+
+#include "traits/height_map.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace terraingen {
+  namespace lod {
+    // vertical extent of a node, in height map units
+    struct lod_height_bounds {
+      float min;
+      float max;
+    };
+
+    /**
+     * @brief Min/max heights and roughness for the nodes of an LOD tree, one level per node size.
+     *        A node is measured the first time something asks about it, from the vertices it and its children would draw -
+     *        so a query costs a chunk's worth of samples, wherever it lands in the tree. Bounds are widened by the node's
+     *        roughness to cover what finer levels might add, and tighten up to the union of the children once all four are known.
+     *        That margin is a heuristic, not a guarantee - it holds while detail keeps shrinking from one level to the next,
+     *        but a feature narrower than a node's sample spacing, like a lone spike, can stick out of the node's bounds
+     *        until the nodes under it are measured.
+     *        Storage is allocated in tiles, as queries reach them. Safe to query from several threads.
+     *
+     * @tparam HeightMap - height map to measure
+     */
+    template <typename HeightMap>
+    class lod_height_pyramid {
+      static_assert(traits::height_map<HeightMap>::value);
+    public:
+      /**
+       * @param height_map - height map to measure
+       * @param size - size of the tree's root node
+       * @param chunk_res - size of the tree's smallest nodes
+       */
+      lod_height_pyramid(std::shared_ptr<HeightMap> height_map, int size, int chunk_res)
+        : height_map_(height_map),
+          size_(size),
+          chunk_res_(chunk_res)
+      {
+        assert(((size) & (size - 1)) == 0);
+        assert(((chunk_res) & (chunk_res - 1)) == 0);
+        assert(size >= chunk_res);
+        for (int node_size = chunk_res_; node_size <= size_; node_size <<= 1) {
+          levels_.emplace_back();
+          levels_.back().dim = size_ / node_size;
+          levels_.back().tiles_across = (levels_.back().dim + tile_dim - 1) / tile_dim;
+          levels_.back().tiles.resize(levels_.back().tiles_across * levels_.back().tiles_across);
+        }
+      }
+
+      /**
+       * @brief Best known heights under a node, edges included. Exact for the smallest nodes.
+       *        Larger ones start out estimated from their own level, and tighten as their children are measured.
+       *
+       * @param x - node's left edge
+       * @param y - node's bottom edge
+       * @param node_size - width of the node. a power of two between chunk_res and size
+       * @return lod_height_bounds - heights under the node
+       */
+      lod_height_bounds GetBounds(int x, int y, int node_size) {
+        std::lock_guard<std::mutex> lock(lock_);
+        const cell& res = Measure(x, y, node_size);
+        return { res.tight_min, res.tight_max };
+      }
+
+      /**
+       * @brief Heights under a node, estimated from its own level alone. An estimate - see above for what it can miss.
+       *        Never changes once measured, so split decisions made against it stay put.
+       *
+       * @param x - node's left edge
+       * @param y - node's bottom edge
+       * @param node_size - width of the node
+       * @return lod_height_bounds - heights under the node
+       */
+      lod_height_bounds GetLevelBounds(int x, int y, int node_size) {
+        std::lock_guard<std::mutex> lock(lock_);
+        const cell& res = Measure(x, y, node_size);
+        return { res.min, res.max };
+      }
+
+      /**
+       * @brief Roughness of a node - the furthest any height drawn by its children strays from the node's own surface.
+       *        0 for the smallest nodes, which are never split.
+       *
+       * @param x - node's left edge
+       * @param y - node's bottom edge
+       * @param node_size - width of the node
+       * @return double - height error, in height map units
+       */
+      double GetError(int x, int y, int node_size) {
+        if (node_size <= chunk_res_) {
+          return 0.0;
+        }
+
+        std::lock_guard<std::mutex> lock(lock_);
+        return Measure(x, y, node_size).error;
+      }
+
+      // forgets everything measured so far, ie after the height map changes
+      void Clear() {
+        std::lock_guard<std::mutex> lock(lock_);
+        for (auto& level : levels_) {
+          for (auto& tile : level.tiles) {
+            tile.reset();
+          }
+        }
+      }
+
+      int GetSize() const {
+        return size_;
+      }
+
+      int GetChunkRes() const {
+        return chunk_res_;
+      }
+
+    private:
+      // cells per tile, along each axis
+      static constexpr int tile_dim = 16;
+
+      struct cell {
+        // from the node's own samples. min > max until measured
+        float min = 1.0f;
+        float max = 0.0f;
+
+        // union of the children's, once they're all measured. same as min/max until then
+        float tight_min;
+        float tight_max;
+
+        double error = 0.0;
+      };
+
+      struct level {
+        // cells along each axis
+        int dim;
+        int tiles_across;
+        std::vector<std::unique_ptr<cell[]>> tiles;
+      };
+
+      const std::shared_ptr<HeightMap> height_map_;
+      const int size_;
+      const int chunk_res_;
+
+      // one level per node size, smallest first
+      std::vector<level> levels_;
+      std::vector<float> samples_;
+      std::mutex lock_;
+
+      size_t GetLevel(int node_size) const {
+        size_t res = 0;
+        while ((chunk_res_ << res) < node_size) {
+          res++;
+        }
+
+        assert(res < levels_.size() && (chunk_res_ << res) == node_size);
+        return res;
+      }
+
+      // cell for a node. null if its tile hasn't been touched yet and alloc is false
+      cell* GetCell(int x, int y, int node_size, bool alloc) {
+        level& lvl = levels_[GetLevel(node_size)];
+        const int cell_x = x / node_size;
+        const int cell_y = y / node_size;
+        auto& tile = lvl.tiles[(cell_y / tile_dim) * lvl.tiles_across + (cell_x / tile_dim)];
+        if (!tile) {
+          if (!alloc) {
+            return nullptr;
+          }
+
+          tile.reset(new cell[tile_dim * tile_dim]);
+        }
+
+        return &tile[(cell_y % tile_dim) * tile_dim + (cell_x % tile_dim)];
+      }
+
+      static bool IsMeasured(const cell* res) {
+        return (res != nullptr && res->min <= res->max);
+      }
+
+      const cell& Measure(int x, int y, int node_size) {
+        cell& res = *GetCell(x, y, node_size, true);
+        if (IsMeasured(&res)) {
+          return res;
+        }
+
+        if (node_size <= chunk_res_) {
+          // smallest nodes sample everything under them
+          Sample(x, y, 1, chunk_res_ + 1);
+          auto range = std::minmax_element(samples_.begin(), samples_.end());
+          res.min = *range.first;
+          res.max = *range.second;
+          res.error = 0.0;
+        } else {
+          // our vertices and our children's - whatever's further down is guessed at from how rough this level is
+          const int fine_count = chunk_res_ * 2;
+          Sample(x, y, node_size / fine_count, fine_count + 1);
+          auto range = std::minmax_element(samples_.begin(), samples_.end());
+          res.error = MeasureError();
+          res.min = static_cast<float>(*range.first - res.error);
+          res.max = static_cast<float>(*range.second + res.error);
+        }
+
+        res.tight_min = res.min;
+        res.tight_max = res.max;
+        Tighten(x, y, node_size, &res);
+
+        // we might be the last child our parents were waiting on
+        int parent_size = node_size * 2;
+        while (parent_size <= size_) {
+          const int parent_x = x & ~(parent_size - 1);
+          const int parent_y = y & ~(parent_size - 1);
+          cell* parent = GetCell(parent_x, parent_y, parent_size, false);
+          if (!IsMeasured(parent) || !Tighten(parent_x, parent_y, parent_size, parent)) {
+            break;
+          }
+
+          parent_size *= 2;
+        }
+
+        return res;
+      }
+
+      // narrows a measured node down to its children, if all of them are measured. returns true if it did
+      bool Tighten(int x, int y, int node_size, cell* res) {
+        if (node_size <= chunk_res_) {
+          return false;
+        }
+
+        const int half_size = node_size / 2;
+        float lo = std::numeric_limits<float>::infinity();
+        float hi = -std::numeric_limits<float>::infinity();
+        for (int i = 0; i < 4; i++) {
+          const cell* child = GetCell(x + (i & 1) * half_size, y + (i >> 1) * half_size, half_size, false);
+          if (!IsMeasured(child)) {
+            return false;
+          }
+
+          lo = std::min(lo, child->tight_min);
+          hi = std::max(hi, child->tight_max);
+        }
+
+        res->tight_min = lo;
+        res->tight_max = hi;
+        return true;
+      }
+
+      // error of the node whose fine grid is in samples_
+      double MeasureError() const {
+        // node draws chunk_res_ quads a side. its children draw twice that, so walk their vertices,
+        // and compare each against the node's quad underneath it
+        const int fine_count = chunk_res_ * 2;
+        const int count = fine_count + 1;
+        double error = 0.0;
+        for (int j = 0; j <= fine_count; j++) {
+          const int y0 = std::min(j & ~1, fine_count - 2);
+          const double t = static_cast<double>(j - y0) * 0.5;
+          for (int i = 0; i <= fine_count; i++) {
+            if (((i | j) & 1) == 0) {
+              // shared with the coarse mesh
+              continue;
+            }
+
+            const int x0 = std::min(i & ~1, fine_count - 2);
+            const double s = static_cast<double>(i - x0) * 0.5;
+            const float* corner = &samples_[y0 * count + x0];
+            const double bottom = corner[0] + (corner[2] - corner[0]) * s;
+            const double top = corner[2 * count] + (corner[2 * count + 2] - corner[2 * count]) * s;
+            const double height = samples_[j * count + i];
+            error = std::max(error, std::abs(height - (bottom + (top - bottom) * t)));
+          }
+        }
+
+        return error;
+      }
+
+      // count x count samples from (x, y), step apart, row major
+      void Sample(int x, int y, int step, int count) {
+        samples_.resize(static_cast<size_t>(count) * count);
+        if constexpr (traits::height_map_region<HeightMap>::value) {
+          height_map_->GetRegion(x, y, step, count, count, samples_.data(), count);
+        } else {
+          for (int j = 0; j < count; j++) {
+            for (int i = 0; i < count; i++) {
+              samples_[j * count + i] = height_map_->Get(x + i * step, y + j * step);
+            }
+          }
+        }
+      }
+    };
+  }
+}
+
+#endif // LOD_HEIGHT_PYRAMID_H_
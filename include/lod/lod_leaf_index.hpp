@@ -0,0 +1,77 @@
+#ifndef LOD_LEAF_INDEX_H_
+#define LOD_LEAF_INDEX_H_
+
+#include "lod/lod_node.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace terraingen {
+  namespace lod {
+    /**
+     * @brief Flat lookup of leaf sizes by integer coordinate.
+     *        Walking a tree bl, br, tl, tr visits leaves in morton order - so leaves are stored sorted by
+     *        the morton code of their bottom left corner, and the leaf holding a point is the last one at or before its code.
+     *        A lookup is a bit interleave, plus a binary search over a contiguous array.
+     *        Chunk building stitches through per-leaf lod_neighbours tables instead - this is for lookups scattered
+     *        across the whole tree, ie VertexGenerator::CreateVertex outside of any one chunk.
+     */
+    class lod_leaf_index {
+    public:
+      // starts out as an empty tree of size 0 - every lookup returns 0 until Build
+      lod_leaf_index() : codes_(1, 0), sizes_(1, 0) {}
+
+      /**
+       * @brief indexes the leaves of a tree. storage is reused between calls.
+       * 
+       * @param tree - root node
+       * @param tree_res - resolution of input tree
+       */
+      void Build(const lod_node* tree, size_t tree_res);
+
+      /**
+       * @brief fetches the size of the leaf covering a unit cell. cells outside the tree land on the nearest edge.
+       * 
+       * @param cell_x - x coordinate of the cell's bottom left corner
+       * @param cell_y - y coordinate of the cell's bottom left corner
+       * @return size_t - size of the leaf, as lod_node::GetChunkSize would return it for any point inside the cell
+       */
+      size_t GetChunkSize(long cell_x, long cell_y) const;
+
+      /**
+       * @brief fetches the size of the chunk half a unit away from a vertex, same as lod_neighbours.
+       * 
+       * @param vertex_x - x coordinate of vertex
+       * @param vertex_y - y coordinate of vertex
+       * @param dir_x - direction along x, -1 or 1
+       * @param dir_y - direction along y, -1 or 1
+       * @return size_t - size of chunk at (vertex_x + dir_x / 2, vertex_y + dir_y / 2)
+       */
+      size_t GetChunkSize(long vertex_x, long vertex_y, int dir_x, int dir_y) const {
+        return GetChunkSize(vertex_x - (dir_x < 0 ? 1 : 0), vertex_y - (dir_y < 0 ? 1 : 0));
+      }
+
+      // number of leaves in the index
+      size_t GetLeafCount() const {
+        return codes_.size();
+      }
+
+      // interleaves x into the even bits, and y into the odd ones
+      static uint64_t Interleave(uint32_t x, uint32_t y);
+
+    private:
+      void Build_recurse(const lod_node* node, uint32_t x, uint32_t y, size_t size);
+
+      // morton code of each leaf's bottom left corner, ascending
+      std::vector<uint64_t> codes_;
+
+      // size of each leaf, alongside codes_
+      std::vector<size_t> sizes_;
+
+      size_t tree_res_ = 0;
+    };
+  }
+}
+
+#endif // LOD_LEAF_INDEX_H_
@@ -0,0 +1,88 @@
+#ifndef LOD_NEIGHBOURS_H_
+#define LOD_NEIGHBOURS_H_
+
+#include "lod/lod_node.hpp"
+
+#include <cstddef>
+#include <vector>
+
+namespace terraingen {
+  namespace lod {
+    /**
+     * @brief Chunk sizes surrounding a single leaf, sampled once per leaf
+     *        so that border vertices don't have to walk the tree.
+     */
+    struct lod_neighbours {
+      // sides of the leaf
+      enum Side {
+        LEFT,
+        RIGHT,
+        BOTTOM,
+        TOP
+      };
+
+      // bottom left corner of our leaf
+      long x;
+      long y;
+
+      // size of our leaf
+      size_t size;
+
+      // distance between vertices
+      size_t step;
+
+      // quads along each axis
+      size_t chunk_res;
+
+      // sizes just outside each side, half a unit before (lo) and after (hi) each vertex along it.
+      // laid out as [side][lo, hi][vertex]. corner neighbours land on the first and last entries.
+      std::vector<size_t> sizes;
+
+      /**
+       * @brief fills this table for the leaf at (x, y). storage is reused between calls.
+       * 
+       * @param tree - root node
+       * @param tree_res - resolution of input tree
+       * @param leaf_x - x offset of leaf
+       * @param leaf_y - y offset of leaf
+       * @param leaf_size - size of leaf
+       * @param leaf_res - number of quads along each axis
+       */
+      void Build(const lod_node* tree, size_t tree_res, long leaf_x, long leaf_y, size_t leaf_size, size_t leaf_res);
+
+      /**
+       * @brief fetches the size of the chunk half a unit away from a vertex on this leaf's border.
+       * 
+       * @param vertex_x - x coordinate of vertex
+       * @param vertex_y - y coordinate of vertex
+       * @param dir_x - direction along x, -1 or 1
+       * @param dir_y - direction along y, -1 or 1
+       * @return size_t - size of chunk at (vertex_x + dir_x / 2, vertex_y + dir_y / 2)
+       */
+      size_t GetChunkSize(long vertex_x, long vertex_y, int dir_x, int dir_y) const {
+        long i = (vertex_x - x) / static_cast<long>(step);
+        long j = (vertex_y - y) / static_cast<long>(step);
+        long res = static_cast<long>(chunk_res);
+        if (i == 0 && dir_x < 0) {
+          return Get(LEFT, dir_y > 0, j);
+        } else if (i == res && dir_x > 0) {
+          return Get(RIGHT, dir_y > 0, j);
+        } else if (j == 0 && dir_y < 0) {
+          return Get(BOTTOM, dir_x > 0, i);
+        } else if (j == res && dir_y > 0) {
+          return Get(TOP, dir_x > 0, i);
+        }
+
+        // inside our own leaf
+        return size;
+      }
+
+    private:
+      size_t Get(Side side, bool hi, long index) const {
+        return sizes[((side * 2) + (hi ? 1 : 0)) * (chunk_res + 1) + index];
+      }
+    };
+  }
+}
+
+#endif // LOD_NEIGHBOURS_H_
@@ -3,6 +3,8 @@
 
 #include <glm/glm.hpp>
 
+#include <cstddef>
+
 namespace terraingen {
   namespace lod {
     struct lod_node {
@@ -35,6 +37,18 @@ namespace terraingen {
        * @return int - size of specified chunk, or -1 if invalid
        */
       static size_t GetChunkSize(const lod_node* node, size_t tree_res, const glm::vec2& sample_point);
+
+      /**
+       * @brief fetches chunk sizes for an axis-aligned line of sample points, in one descent.
+       * 
+       * @param node - root node
+       * @param tree_res - resolution of input tree.
+       * @param origin - first sample point
+       * @param step - offset between sample points. must run along x or y, in the positive direction.
+       * @param count - number of sample points
+       * @param output - receives the size of each point's chunk, as GetChunkSize would return it.
+       */
+      static void GetChunkSizeLine(const lod_node* node, size_t tree_res, const glm::vec2& origin, const glm::vec2& step, size_t count, size_t* output);
     };
   }
 }
@@ -0,0 +1,44 @@
+#ifndef LOD_TREE_DIFF_H_
+#define LOD_TREE_DIFF_H_
+
+#include <cstddef>
+#include <vector>
+
+namespace terraingen {
+  namespace lod {
+    // a single leaf of an lod tree, in tree space
+    struct lod_leaf {
+      // bottom left corner
+      long x;
+      long y;
+
+      // width of the leaf
+      size_t size;
+
+      bool operator==(const lod_leaf& rhs) const {
+        return (rhs.x == x && rhs.y == y && rhs.size == size);
+      }
+    };
+
+    /**
+     * @brief Leaves which changed between two versions of a tree.
+     *        Take the removed leaves out of the old tree's leaves and put the added ones in, and you have the new tree's.
+     */
+    struct lod_tree_diff {
+      std::vector<lod_leaf> added;
+      std::vector<lod_leaf> removed;
+
+      bool Empty() const {
+        return (added.empty() && removed.empty());
+      }
+
+      // keeps storage around for the next update
+      void Clear() {
+        added.clear();
+        removed.clear();
+      }
+    };
+  }
+}
+
+#endif // LOD_TREE_DIFF_H_
@@ -0,0 +1,25 @@
+#ifndef APPROXIMATE_SAMPLING_H_
+#define APPROXIMATE_SAMPLING_H_
+
+#include <cstddef>
+
+namespace terraingen {
+  namespace terrain {
+    /**
+     * @brief Settings for building far chunks from a sparse set of height samples.
+     */
+    struct ApproximateSampling {
+      // chunks spanning at least this many samples are approximated. 0 turns approximation off.
+      size_t min_chunk_size = 0;
+
+      // distance between sampled heights, in vertices. PoT, at least 2.
+      size_t lattice_step = 2;
+
+      // largest height error we accept before falling back to sampling every vertex.
+      // checked at the center of every lattice cell - features narrower than a cell can still slip between checks
+      float max_error = 0.0f;
+    };
+  }
+}
+
+#endif // APPROXIMATE_SAMPLING_H_
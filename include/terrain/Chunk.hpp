@@ -4,7 +4,9 @@
 #include "terrain/VertexGenerator.hpp"
 #include "terrain/Vertex.hpp"
 
-#include "lod/lod_node.hpp"
+#include "lod/lod_neighbours.hpp"
+#include "traits/height_map.hpp"
+#include "util/StaticSize.hpp"
 
 #include <memory>
 #include <vector>
@@ -12,8 +14,16 @@
 // build a single chunk at a time
 namespace terraingen {
   namespace terrain {    
-    struct Chunk {
-      Vertex* vertex_data;
+    /**
+     * @brief A single chunk of terrain, storing only the vertex attributes in its mask.
+     *
+     * @tparam Attributes - mask of VertexAttribute flags
+     */
+    template <unsigned int Attributes = ALL_ATTRIBUTES>
+    struct BasicChunk {
+      typedef VertexFormat<Attributes> VertexType;
+
+      VertexType* vertex_data;
       unsigned int* index_data;
 
       size_t vertex_count;
@@ -28,48 +38,228 @@ namespace terraingen {
        * @param offset_y - y offset
        * @param offset_index - integer offset for indices.
        * @param step - step size for offset.
-       * @param chunk_res - number of quads along each axis
-       * @param lod - root of our LOD tree.
-       * @return std::shared_ptr<Chunk> - pointer to populated chunk.
+       * @param chunk_resolution - number of quads along each axis
+       * @param neighbours - chunk sizes surrounding this chunk, for stitching.
+       * @return std::shared_ptr<BasicChunk> - pointer to populated chunk.
        */
-      template <typename HeightMap>
-      static std::shared_ptr<Chunk> chunk_create(
-        VertexGenerator<HeightMap>& vert_generator,
+      template <typename HeightMap, size_t ChunkRes>
+      static std::shared_ptr<BasicChunk> chunk_create(
+        VertexGenerator<HeightMap, Attributes, ChunkRes>& vert_generator,
         long offset_x,
         long offset_y,
         unsigned int offset_index,
         size_t step,
-        size_t chunk_res,
-        const lod::lod_node* lod) 
+        size_t chunk_resolution,
+        const lod::lod_neighbours& neighbours) 
       {
-        Vertex* vert_data = new Vertex[(chunk_res + 1) * (chunk_res + 1)];
-        for (int y = 0; y <= chunk_res; y++) {
-          for (int x = 0; x <= chunk_res; x++) {
-            vert_data[x * (chunk_res + 1) + y] = vert_generator.CreateVertex(x * step + offset_x, y * step + offset_y, step, lod);
+        const util::StaticSize<ChunkRes> chunk_res(chunk_resolution);
+        VertexType* vert_data = new VertexType[(chunk_res + 1) * (chunk_res + 1)];
+
+        if constexpr (traits::height_map_gradient<HeightMap>::value) {
+          // every vertex is a single sample already, nothing to share
+          for (int y = 0; y <= chunk_res; y++) {
+            for (int x = 0; x <= chunk_res; x++) {
+              StoreVertex<Attributes>(vert_generator.CreateVertex(x * step + offset_x, y * step + offset_y, step, neighbours), vert_data[x * (chunk_res + 1) + y]);
+            }
           }
+
+          return chunk_wrap(vert_data, chunk_res);
         }
 
-        auto res = std::shared_ptr<Chunk>(new Chunk());
-        res->vertex_data = vert_data;
-        res->vertex_count = (chunk_res + 1) * (chunk_res + 1);
-        res->index_count = 0;
+        // sample every height once, with a 1 sample border for normals along the edges
+        if (vert_generator.ShouldApproximate(step)) {
+          vert_generator.LoadHeightGridApproximate(offset_x - step, offset_y - step, step, chunk_res + 3);
+        } else {
+          vert_generator.LoadHeightGrid(offset_x - step, offset_y - step, step, chunk_res + 3);
+        }
+        chunk_build(vert_generator, vert_data, offset_x, offset_y, step, chunk_res, neighbours);
+        return chunk_wrap(vert_data, chunk_res);
+      }
 
-        return res;
+      /**
+       * @brief Creates a new chunk from the four chunks a level below it.
+       *        Interior heights come from the children - only the border is sampled.
+       *        Needs positions in the mask, so the children have heights to give.
+       * 
+       * @tparam HeightMap - format for height map
+       * @param vert_generator - vertex generator.
+       * @param offset_x - x offset
+       * @param offset_y - y offset
+       * @param step - step size for offset.
+       * @param chunk_resolution - number of quads along each axis
+       * @param neighbours - chunk sizes surrounding this chunk, for stitching.
+       * @param children - bl, br, tl, tr children, built with half our step.
+       * @return std::shared_ptr<BasicChunk> - pointer to populated chunk.
+       */
+      template <typename HeightMap, size_t ChunkRes>
+      static std::shared_ptr<BasicChunk> chunk_create_downsampled(
+        VertexGenerator<HeightMap, Attributes, ChunkRes>& vert_generator,
+        long offset_x,
+        long offset_y,
+        size_t step,
+        size_t chunk_resolution,
+        const lod::lod_neighbours& neighbours,
+        const std::shared_ptr<BasicChunk> children[4])
+      {
+        const util::StaticSize<ChunkRes> chunk_res(chunk_resolution);
+        VertexType* vert_data = new VertexType[(chunk_res + 1) * (chunk_res + 1)];
+        const int half_res = static_cast<int>(chunk_res / 2);
+
+        // child vertex sharing a location with our interior vertex (x, y)
+        // child borders might be stitched to something coarser, but our interior never touches them
+        auto child_vertex = [&](int x, int y) -> const VertexType& {
+          int child = (x < half_res ? 0 : 1) + (y < half_res ? 0 : 2);
+          int child_x = 2 * x - (x < half_res ? 0 : chunk_res);
+          int child_y = 2 * y - (y < half_res ? 0 : chunk_res);
+          return children[child]->vertex_data[child_x * (chunk_res + 1) + child_y];
+        };
+
+        if constexpr (traits::height_map_gradient<HeightMap>::value) {
+          // analytic vertices don't depend on step, so interior ones carry over as-is
+          for (int y = 0; y <= chunk_res; y++) {
+            for (int x = 0; x <= chunk_res; x++) {
+              if (x == 0 || y == 0 || x == chunk_res || y == chunk_res) {
+                StoreVertex<Attributes>(vert_generator.CreateVertex(x * step + offset_x, y * step + offset_y, step, neighbours), vert_data[x * (chunk_res + 1) + y]);
+              } else {
+                vert_data[x * (chunk_res + 1) + y] = child_vertex(x, y);
+              }
+            }
+          }
+
+          return chunk_wrap(vert_data, chunk_res);
+        }
+
+        const size_t dim = chunk_res + 3;
+        const int rings = VertexGenerator<HeightMap, Attributes, ChunkRes>::border_rings;
+        vert_generator.ResetHeightGrid(offset_x - step, offset_y - step, step, dim);
+
+        // grid is offset by one from our vertices
+        for (int y = rings - 1; y < static_cast<int>(dim) - rings - 1; y++) {
+          for (int x = rings - 1; x < static_cast<int>(dim) - rings - 1; x++) {
+            vert_generator.SetGridHeight(x + 1, y + 1, child_vertex(x, y));
+          }
+        }
+
+        // border heights get shared with neighbours, so they come straight from the map
+        vert_generator.SampleHeightGridBorder();
+
+        chunk_build(vert_generator, vert_data, offset_x, offset_y, step, chunk_res, neighbours);
+        return chunk_wrap(vert_data, chunk_res);
       }
 
       // dtor
-      ~Chunk();
+      ~BasicChunk() {
+        if (vertex_data != nullptr) {
+          delete[] vertex_data;
+        }
+
+        if (index_data != nullptr) {
+          delete[] index_data;
+        }
+      }
 
       // disable copy
-      Chunk(const Chunk& other) = delete;
-      Chunk& operator=(const Chunk& other) = delete;
+      BasicChunk(const BasicChunk& other) = delete;
+      BasicChunk& operator=(const BasicChunk& other) = delete;
 
       // move
-      Chunk(Chunk&& other);
-      Chunk& operator=(Chunk&& other);
+      BasicChunk(BasicChunk&& other) {
+        vertex_data = other.vertex_data;
+        index_data = other.index_data;
+
+        other.vertex_data = nullptr;
+        other.index_data = nullptr;
+      }
+
+      BasicChunk& operator=(BasicChunk&& other) {
+        if (vertex_data != nullptr) {
+          delete[] vertex_data;
+        }
+
+        if (index_data != nullptr) {
+          delete[] index_data;
+        }
+
+        vertex_data = other.vertex_data;
+        index_data = other.index_data;
+
+        other.vertex_data = nullptr;
+        other.index_data = nullptr;
+
+        return *this;
+      }
     private:
-      Chunk() {};
+      BasicChunk() {};
+
+      // builds vertices from a loaded height grid, then clears it
+      template <typename HeightMap, size_t ChunkRes>
+      static void chunk_build(
+        VertexGenerator<HeightMap, Attributes, ChunkRes>& vert_generator,
+        VertexType* vert_data,
+        long offset_x,
+        long offset_y,
+        size_t step,
+        util::StaticSize<ChunkRes> chunk_res,
+        const lod::lod_neighbours& neighbours)
+      {
+        // vertices are stored x-major, so rows along x are strided
+        const size_t row_stride = (chunk_res + 1) * sizeof(VertexType);
+        for (int y = 0; y <= chunk_res; y++) {
+          if (y == 0 || y == chunk_res) {
+            for (int x = 0; x <= chunk_res; x++) {
+              StoreVertex<Attributes>(vert_generator.CreateVertex(x * step + offset_x, y * step + offset_y, step, neighbours), vert_data[x * (chunk_res + 1) + y]);
+            }
+
+            continue;
+          }
+
+          // edges might have to stitch to a neighbor
+          StoreVertex<Attributes>(vert_generator.CreateVertex(offset_x, y * step + offset_y, step, neighbours), vert_data[y]);
+          StoreVertex<Attributes>(vert_generator.CreateVertex(chunk_res * step + offset_x, y * step + offset_y, step, neighbours), vert_data[chunk_res * (chunk_res + 1) + y]);
+
+          // interior runs go through the row kernel
+          VertexStreams streams = chunk_streams(&vert_data[(chunk_res + 1) + y], row_stride);
+          vert_generator.CreateVertexRow(step + offset_x, y * step + offset_y, chunk_res - 1, streams);
+        }
+
+        vert_generator.ClearHeightGrid();
+      }
+
+      // kernel streams for the attributes we store, null for the rest
+      static VertexStreams chunk_streams(VertexType* vertex, size_t stride) {
+        VertexStreams res { nullptr, nullptr, nullptr, nullptr, stride };
+        if constexpr ((Attributes & POSITION) != 0) {
+          res.position = &vertex->position;
+        }
+
+        if constexpr ((Attributes & NORMAL) != 0) {
+          res.normal = &vertex->normal;
+        }
+
+        if constexpr ((Attributes & TEXCOORD) != 0) {
+          res.texcoord = &vertex->texcoord;
+        }
+
+        if constexpr ((Attributes & TANGENT) != 0) {
+          res.tangent = &vertex->tangent;
+        }
+
+        return res;
+      }
+
+      // takes ownership of vertex data
+      static std::shared_ptr<BasicChunk> chunk_wrap(VertexType* vert_data, size_t chunk_res) {
+        auto res = std::shared_ptr<BasicChunk>(new BasicChunk());
+        res->vertex_data = vert_data;
+        res->index_data = nullptr;
+        res->vertex_count = (chunk_res + 1) * (chunk_res + 1);
+        res->index_count = 0;
+
+        return res;
+      }
     };
+
+    typedef BasicChunk<ALL_ATTRIBUTES> Chunk;
   }
 }
 
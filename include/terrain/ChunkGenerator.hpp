@@ -2,67 +2,387 @@
 #define CHUNK_GENERATOR_H_
 
 #include "terrain/Vertex.hpp"
+#include "util/Executor.hpp"
 #include "util/LRUCache.hpp"
+#include "util/ShardedLRUCache.hpp"
+#include "util/StaticSize.hpp"
+#include "util/WorkStealingPool.hpp"
 #include "traits/height_map.hpp"
 #include "lod/lod_node.hpp"
+#include "lod/lod_neighbours.hpp"
 
 #include "terrain/Chunk.hpp"
 #include "terrain/ChunkIdentifier.hpp"
-
+#include "terrain/ChunkSnapshot.hpp"
+#include "terrain/UpdateBudget.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <limits>
 #include <memory>
+#include <stdexcept>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
 #include <glm/glm.hpp>
 
 namespace terraingen {
   namespace terrain {
-    template <typename HeightMap>
+    /**
+     * @brief Builds and caches chunks for an LOD tree.
+     *
+     * @tparam HeightMap - format for height map
+     * @tparam Attributes - mask of VertexAttribute flags to compute and store.
+     *                      Vertex buffers are written as VertexFormat<Attributes>.
+     * @tparam ChunkRes - chunk resolution, if known at compile time. 0 reads it at runtime.
+     *                    Otherwise chunk_resolution has to match, or the constructor throws std::invalid_argument.
+     */
+    template <typename HeightMap, unsigned int Attributes = ALL_ATTRIBUTES, size_t ChunkRes = 0>
     class ChunkGenerator {
       static_assert(sizeof(Vertex) == 48);
       static_assert(traits::height_map<HeightMap>::value);
+
+      typedef BasicChunk<Attributes> ChunkType;
+      typedef VertexFormat<Attributes> VertexType;
     public:
+      // chunk store, safe to share between generators
+      typedef util::ShardedLRUCache<ChunkIdentifier, std::shared_ptr<ChunkType>> ChunkCache;
+
+      // published chunk set, readable from any thread
+      typedef ChunkSnapshot<Attributes, ChunkRes> Snapshot;
+
       ChunkGenerator(
         std::shared_ptr<HeightMap> height,
         float horizontal_scale,
         double texcoord_scale,
         const glm::vec3& terrain_offset,
         size_t chunk_resolution) 
-        : chunk_data_(256),
+        : chunk_data_(std::make_shared<ChunkCache>(256)),
+          variant_data_(64),
+          vertex_cache_(4096),
           height_(height),
           horizontal_scale_(horizontal_scale),
           texcoord_scale_(texcoord_scale),
           terrain_offset_(terrain_offset),
-          chunk_res_(chunk_resolution)
+          chunk_res_(chunk_resolution),
+          published_(std::make_shared<Snapshot>(chunk_resolution)),
+          executor_(std::make_shared<util::InlineExecutor>())
       {
+        if (ChunkRes != 0 && chunk_resolution != ChunkRes) {
+          // buffers would be sized for one resolution and filled at the other
+          throw std::invalid_argument("chunk_resolution does not match ChunkRes");
+        }
+
         // store all of this
+        auto settings = std::make_shared<WriteSettings>();
+        settings->executor = executor_;
+        settings->index_template = std::make_shared<std::vector<unsigned int>>(Snapshot::CreateIndexTemplate(chunk_resolution));
+        write_settings_ = settings;
       }
 
+      /**
+       * @brief Builds chunks for an LOD tree, and publishes them to our outputs.
+       * 
+       * @param node - root of the LOD tree
+       * @param tree_res - size of the LOD tree
+       */
       void UpdateChunks(const lod::lod_node* node, size_t tree_res) {
-        index_offset = 0;
-        chunk_data_.Reserve(GetChunkCount_recurse(node) + 1);
-        VertexGenerator<HeightMap> gen(
-          height_,
-          horizontal_scale_,
-          texcoord_scale_,
-          chunk_res_,
-          tree_res,
-          terrain_offset_
-        );
-        chunk_count_ = UpdateChunks_recurse(0, 0, tree_res, tree_res, node, node, gen);
+        StageChunks(node, tree_res);
+        PublishChunks();
+      }
+
+      /**
+       * @brief Builds chunks for an LOD tree, nearest to the observer first, and publishes them to our outputs.
+       * 
+       * @param node - root of the LOD tree
+       * @param tree_res - size of the LOD tree
+       * @param observer - position the tree was built around, in tree space
+       */
+      void UpdateChunks(const lod::lod_node* node, size_t tree_res, const glm::vec3& observer) {
+        StageChunks(node, tree_res, observer);
+        PublishChunks();
+      }
+
+      /**
+       * @brief Builds as many chunks as fit in a budget, nearest to the observer first, and publishes them to our outputs.
+       *        Leaves which didn't make it are covered by their nearest cached ancestor.
+       *        Call again each frame to keep refining.
+       * 
+       * @param node - root of the LOD tree
+       * @param tree_res - size of the LOD tree
+       * @param observer - position the tree was built around, in tree space
+       * @param budget - limits on building
+       * @return true if every leaf of the tree is drawn at its own resolution
+       */
+      bool UpdateChunks(const lod::lod_node* node, size_t tree_res, const glm::vec3& observer, const UpdateBudget& budget) {
+        StageChunks(node, tree_res, observer, budget);
+        PublishChunks();
+        return IsComplete();
+      }
+
+      /**
+       * @brief Builds chunks for an LOD tree, without touching our outputs. Finest chunks are built first.
+       *        Safe to run while another thread reads outputs, as long as nothing publishes meanwhile.
+       * 
+       * @param node - root of the LOD tree
+       * @param tree_res - size of the LOD tree
+       * @param cancel - optional flag. once set, we stop building and stage nothing.
+       *                 chunks finished by then are cached, for whichever tree comes next.
+       * @return true if the chunk set was staged
+       */
+      bool StageChunks(const lod::lod_node* node, size_t tree_res, const std::atomic<bool>* cancel = nullptr) {
+        return StageChunks_internal(&node, nullptr, 1, tree_res, nullptr, cancel);
+      }
+
+      /**
+       * @brief Builds chunks for an LOD tree, nearest to the observer first, without touching our outputs.
+       * 
+       * @param node - root of the LOD tree
+       * @param tree_res - size of the LOD tree
+       * @param observer - position the tree was built around, in tree space
+       * @param cancel - optional flag. once set, we stop building and stage nothing.
+       *                 chunks finished by then are cached, for whichever tree comes next.
+       * @return true if the chunk set was staged
+       */
+      bool StageChunks(const lod::lod_node* node, size_t tree_res, const glm::vec3& observer, const std::atomic<bool>* cancel = nullptr) {
+        return StageChunks_internal(&node, &observer, 1, tree_res, nullptr, cancel);
+      }
+
+      /**
+       * @brief Builds as many chunks as fit in a budget, nearest to the observer first, without touching our outputs.
+       *        Leaves which didn't make it are covered by their nearest cached ancestor.
+       *        Anything with no cached ancestor is built coarse, over budget if need be.
+       * 
+       * @param node - root of the LOD tree
+       * @param tree_res - size of the LOD tree
+       * @param observer - position the tree was built around, in tree space
+       * @param budget - limits on building
+       * @param cancel - optional flag. once set, we stop building and stage nothing.
+       * @return true if the chunk set was staged
+       */
+      bool StageChunks(const lod::lod_node* node, size_t tree_res, const glm::vec3& observer, const UpdateBudget& budget, const std::atomic<bool>* cancel = nullptr) {
+        return StageChunks_internal(&node, &observer, 1, tree_res, &budget, cancel);
+      }
+
+      /**
+       * @brief Builds chunks for several LOD trees at once, one per view, and publishes them to our outputs.
+       *        Chunks shared between views are built once.
+       * 
+       * @param trees - root of the LOD tree for each view
+       * @param tree_res - size of the LOD trees
+       * @param observers - position each tree was built around, in tree space
+       */
+      void UpdateChunks(const std::vector<const lod::lod_node*>& trees, size_t tree_res, const std::vector<glm::vec3>& observers) {
+        StageChunks(trees, tree_res, observers);
+        PublishChunks();
+      }
+
+      /**
+       * @brief Builds chunks for several LOD trees at once, one per view, without touching our outputs.
+       *        Chunks shared between views are built once, nearest to any observer first.
+       *        Where views border a shared leaf with different sizes, each way of stitching it is built and cached separately.
+       * 
+       * @param trees - root of the LOD tree for each view
+       * @param tree_res - size of the LOD trees
+       * @param observers - position each tree was built around, in tree space. one per tree
+       * @param cancel - optional flag. once set, we stop building and stage nothing.
+       * @return true if the chunk sets were staged
+       */
+      bool StageChunks(
+        const std::vector<const lod::lod_node*>& trees,
+        size_t tree_res,
+        const std::vector<glm::vec3>& observers,
+        const std::atomic<bool>* cancel = nullptr
+      ) {
+        assert(trees.size() == observers.size());
+        return StageChunks_internal(trees.data(), observers.data(), trees.size(), tree_res, nullptr, cancel);
+      }
+
+      /**
+       * @brief Builds chunks for a tree we expect to need soon, straight into our cache. Outputs are left alone.
+       *        Safe to run alongside readers the same way StageChunks is.
+       * 
+       * @param node - root of the predicted LOD tree
+       * @param tree_res - size of the LOD tree
+       * @param observer - predicted position, in tree space. nearest chunks are built first
+       * @param budget - limits on building. as with updates, the first missing chunk is built regardless
+       * @param cancel - optional flag. once set, we stop building. finished chunks are kept
+       * @return size_t - number of chunks built
+       */
+      size_t PrefetchChunks(
+        const lod::lod_node* node,
+        size_t tree_res,
+        const glm::vec3& observer,
+        const UpdateBudget& budget,
+        const std::atomic<bool>* cancel = nullptr
+      ) {
+        const auto deadline = GetDeadline(&budget);
+        int node_count = GetChunkCount_recurse(node);
+
+        // room for this tree without pushing out the one we're drawing
+        ReserveChunks(stage_node_count_ + node_count + 1);
+
+        pending_.clear();
+        CollectChunks_recurse(0, 0, tree_res, node, node);
+        FindSharedChunks(1, tree_res);
+        FindMissingChunks(&observer, 1);
+
+        size_t limit = missing_.size();
+        if (budget.max_chunks > 0) {
+          limit = std::min(limit, budget.max_chunks);
+        }
+
+        GenerateChunks(pending_, limit, deadline, tree_res, node_count, cancel);
+
+        size_t built = 0;
+        for (auto& pending : pending_) {
+          built += (!pending.cached && pending.chunk ? 1 : 0);
+        }
+
+        PutBuiltChunks(pending_);
+        pending_.clear();
+        return built;
+      }
+
+      /**
+       * @brief Makes the last staged chunk set our output. Does nothing if nothing new was staged.
+       * 
+       * @return true if a new chunk set was published
+       */
+      bool PublishChunks() {
+        if (!has_staged_) {
+          return false;
+        }
+
+        // readers holding the old set keep it, along with its chunks, until they let go
+        std::atomic_store(&published_, std::shared_ptr<const Snapshot>(std::make_shared<Snapshot>(std::move(staged_), chunk_res_, write_settings_)));
+        staged_.clear();
+        has_staged_ = false;
+        return true;
+      }
+
+      /**
+       * @return true if a chunk set is staged, and waiting to be published
+       */
+      bool HasStagedChunks() const {
+        return has_staged_;
+      }
+
+      /**
+       * @brief Grabs the published chunk set. Safe to call from any thread, alongside updates -
+       *        the snapshot never changes, so sizes read from it always match what it writes.
+       * 
+       * @return std::shared_ptr<const Snapshot> - the published chunk set. never null
+       */
+      std::shared_ptr<const Snapshot> GetSnapshot() const {
+        return std::atomic_load(&published_);
+      }
+
+      /**
+       * @param view - which view to check
+       * @return true if the published chunk set draws every leaf of its tree, rather than placeholders for some
+       */
+      bool IsComplete(size_t view = 0) const {
+        return GetSnapshot()->IsComplete(view);
+      }
+
+      /**
+       * @return size_t - number of views in the published chunk set
+       */
+      size_t GetViewCount() const {
+        return GetSnapshot()->GetViewCount();
+      }
+
+      /**
+       * @brief Stores chunks in a cache shared with other generators, instead of one of our own.
+       *        Everyone sharing a cache has to agree on height map, scales, offset and chunk resolution -
+       *        chunks are looked up by position and size alone.
+       *        Each generator grows the cache by what it needs on top of its starting capacity.
+       * 
+       * @param cache - cache to use. null goes back to a private one.
+       */
+      void SetChunkCache(std::shared_ptr<ChunkCache> cache) {
+        if (cache) {
+          chunk_data_ = std::move(cache);
+          reserved_chunks_ = 0;
+        } else {
+          chunk_data_ = std::make_shared<ChunkCache>(256);
+          reserved_chunks_ = 256;
+        }
+      }
+
+      std::shared_ptr<ChunkCache> GetChunkCache() {
+        return chunk_data_;
       }
 
+      /**
+       * @brief Sets where missing chunks get built, and buffer writes split up. The caller always helps out.
+       *        With more than one thread, the height map must be safe to sample from several threads at once.
+       * 
+       * @param executor - executor to build chunks on. null (the default) builds everything on the caller.
+       */
+      void SetExecutor(std::shared_ptr<util::Executor> executor) {
+        executor_ = (executor ? std::move(executor) : std::make_shared<util::InlineExecutor>());
+
+        // snapshots we've already handed out keep writing on the old one
+        auto settings = std::make_shared<WriteSettings>(*write_settings_);
+        settings->executor = executor_;
+        write_settings_ = settings;
+      }
+
+      /**
+       * @brief Makes buffer writes use non-temporal stores, which skip the cache.
+       *        Faster when writing straight into mapped gpu staging memory, slower into memory read back soon after.
+       *        Applies to snapshots published after this call.
+       * 
+       * @param streaming - true to stream writes
+       */
+      void SetStreamingWrites(bool streaming) {
+        auto settings = std::make_shared<WriteSettings>(*write_settings_);
+        settings->streaming = streaming;
+        write_settings_ = settings;
+      }
+
+      /**
+       * @brief Builds missing chunks on a pool of our own.
+       * 
+       * @param threads - number of threads, counting the caller. 1 builds everything on the caller.
+       */
+      void SetThreadCount(size_t threads) {
+        SetExecutor(threads > 1 ? std::make_shared<util::WorkStealingPool>(threads - 1) : nullptr);
+      }
+
+      /**
+       * @brief Lets large chunks interpolate most of their heights from a sparse set of samples.
+       *        Only applies to chunks created after this call.
+       * 
+       * @param settings - approximation settings. min_chunk_size 0 turns it off.
+       */
+      void SetApproximateSampling(const ApproximateSampling& settings) {
+        approximate_ = settings;
+      }
+
+      // outputs read the published snapshot. every output takes a view - the observer whose chunks to read.
+      // single tree updates only fill view 0.
+      // each call grabs the latest snapshot - readers on another thread should hold one from GetSnapshot instead,
+      // so an update landing between two calls can't change the chunk count under them
+
       // return number of chunks
-      size_t GetChunkCount() {
-        return chunk_count_;
+      size_t GetChunkCount(size_t view = 0) {
+        return GetSnapshot()->GetChunkCount(view);
       }
 
       // return vertex buffer size in bytes
-      size_t GetVertexBufferSize() {
-        return chunk_count_ * (chunk_res_ + 1) * (chunk_res_ + 1) * sizeof(Vertex);
+      size_t GetVertexBufferSize(size_t view = 0) {
+        return GetSnapshot()->GetVertexBufferSize(view);
       }
 
       // return index buffer size in bytes
-      size_t GetIndexBufferSize() {
-        return chunk_count_ * chunk_res_ * chunk_res_ * 6 * sizeof(unsigned int);
+      size_t GetIndexBufferSize(size_t view = 0) {
+        return GetSnapshot()->GetIndexBufferSize(view);
       }
 
       /**
@@ -70,147 +390,494 @@ namespace terraingen {
        * 
        * @param dst - destination buffer
        * @param n - number of bytes in destination buffer
+       * @param view - which view to write
        * @return size_t - number of bytes written
        */
-      size_t WriteVertexBuffer(void* dst, size_t n) {
-        unsigned char* ptr = reinterpret_cast<unsigned char*>(dst);
-        if (chunk_count_ <= 0) {
-          return 0;
-        }
-
-        size_t chunk_size_bytes = (chunk_res_ + 1) * (chunk_res_ + 1) * sizeof(Vertex);
-        size_t bytes_written = 0;
-        for (auto itr = chunk_data_.begin_bounded(chunk_count_); itr != chunk_data_.end(); itr++) {
-          if (n < chunk_size_bytes) {
-            break;
-          }
-
-          memcpy(ptr, (*itr)->vertex_data, chunk_size_bytes);
-          n -= chunk_size_bytes;
-          bytes_written += chunk_size_bytes;
-          ptr += chunk_size_bytes;
-        }
-
-        return bytes_written;
+      size_t WriteVertexBuffer(void* dst, size_t n, size_t view = 0) {
+        return GetSnapshot()->WriteVertexBuffer(dst, n, view);
       }
 
       /**
-       * @brief Writes vertex buffer to separated attribute buffers
+       * @brief Writes vertex buffer to separated attribute buffers.
+       *        Attributes outside of our mask are skipped, and their buffers may be null.
        * 
        * @param positions - position output
        * @param normals - normal output
        * @param texcoords - texcoord output
        * @param tangents - tangent output
        * @param vertices - max number of vertices we can write across our attribute buffers
+       * @param view - which view to write
        * @return size_t - number of vertices written
        */
-      size_t WriteVertexBufferSeparate(glm::vec3* positions, glm::vec3* normals, glm::vec2* texcoords, glm::vec4* tangents, const size_t vertices) {
-        if (chunk_count_ <= 0) {
-          return 0;
+      size_t WriteVertexBufferSeparate(glm::vec3* positions, glm::vec3* normals, glm::vec2* texcoords, glm::vec4* tangents, const size_t vertices, size_t view = 0) {
+        return GetSnapshot()->WriteVertexBufferSeparate(positions, normals, texcoords, tangents, vertices, view);
+      }
+
+      size_t WriteIndexBuffer(void* dst, size_t n, size_t view = 0) {
+        return GetSnapshot()->WriteIndexBuffer(dst, n, view);
+      }
+
+    private:
+      // a leaf of the current tree
+      struct PendingChunk {
+        ChunkIdentifier identifier;
+        std::shared_ptr<ChunkType> chunk;
+
+        // true if the chunk came from our cache
+        bool cached;
+
+        // tree we stitch against
+        const lod::lod_node* tree;
+
+        // true if another view shares our identifier, but stitches it differently.
+        // we get a chunk of our own, cached apart from the rest by its neighbour sizes - the chunk cache holds the first view's
+        bool variant = false;
+      };
+
+      // chunk set for one view
+      typedef typename Snapshot::View ViewOutput;
+      typedef typename Snapshot::WriteSettings WriteSettings;
+
+      // scratch for a slot building chunks
+      struct Worker {
+        Worker() : vertex_cache(4096) {}
+
+        VertexCache vertex_cache;
+        lod::lod_neighbours neighbours;
+      };
+
+      bool StageChunks_internal(
+        const lod::lod_node* const* trees,
+        const glm::vec3* observers,
+        size_t view_count,
+        size_t tree_res,
+        const UpdateBudget* budget,
+        const std::atomic<bool>* cancel
+      ) {
+        const auto deadline = GetDeadline(budget);
+        size_t node_count = 0;
+        for (size_t view = 0; view < view_count; view++) {
+          node_count += GetChunkCount_recurse(trees[view]);
+        }
+
+        stage_node_count_ = node_count;
+        ReserveChunks(node_count + 1);
+
+        // find every leaf, and which of them we already have
+        pending_.clear();
+        view_begin_.clear();
+        for (size_t view = 0; view < view_count; view++) {
+          view_begin_.push_back(pending_.size());
+          CollectChunks_recurse(0, 0, tree_res, trees[view], trees[view]);
         }
 
-        size_t n = vertices;
-        size_t vertices_drawn = 0;
+        view_begin_.push_back(pending_.size());
+
+        // build the rest, most important first. views share anything they have in common
+        FindSharedChunks(view_count, tree_res);
+        FindMissingChunks(observers, view_count);
+        size_t limit = missing_.size();
+        if (budget != nullptr && budget->max_chunks > 0) {
+          limit = std::min(limit, budget->max_chunks);
+        }
+
+        GenerateChunks(pending_, limit, deadline, tree_res, node_count, cancel);
+        PutBuiltVariants();
+        for (size_t i = 0; i < pending_.size(); i++) {
+          if (!pending_[i].chunk) {
+            pending_[i].chunk = pending_[shared_[i]].chunk;
+          }
+        }
+
+        // leaves we didn't get to are drawn with something coarser
+        bool complete = true;
+        forced_.clear();
+        drawn_.resize(std::max(drawn_.size(), view_count));
+        view_complete_.assign(view_count, true);
+        for (size_t view = 0; view < view_count && !(cancel != nullptr && cancel->load()); view++) {
+          std::vector<PendingChunk>& drawn = drawn_[view];
+          drawn.assign(pending_.begin() + view_begin_[view], pending_.begin() + view_begin_[view + 1]);
+          if (std::all_of(drawn.begin(), drawn.end(), [](const PendingChunk& pending) { return !!pending.chunk; })) {
+            continue;
+          }
+
+          complete = false;
+          view_complete_[view] = false;
+          drawn.clear();
+          size_t leaf = view_begin_[view];
+          if (!CoverChunks_recurse(0, 0, tree_res, trees[view], &leaf, &drawn)) {
+            // some holes have no cached ancestor at all - one coarse chunk over everything is the cheapest fix.
+            // built over budget, but only once: it's cached from here on, and shared between views
+            if (forced_.empty()) {
+              forced_.push_back({ { 0, 0, tree_res }, nullptr, false, trees[view] });
+              missing_.assign(1, 0);
+              GenerateChunks(forced_, 1, std::chrono::steady_clock::time_point::max(), tree_res, node_count, cancel);
+            }
 
-        size_t chunk_size = (chunk_res_ + 1) * (chunk_res_ + 1);
-        Vertex* vertex_data;
-        for (auto itr = chunk_data_.begin_bounded(chunk_count_); itr != chunk_data_.end(); itr++) {
-          if (n < chunk_size) {
-            break;
+            drawn.assign(1, forced_.front());
           }
+        }
+
+        if (cancel != nullptr && cancel->load()) {
+          // keep what we finished - the next tree probably wants most of it
+          PutBuiltChunks(pending_);
+          PutBuiltChunks(forced_);
+          pending_.clear();
+          forced_.clear();
+          return false;
+        }
+
+        if (!complete) {
+          // built leaves hidden behind a placeholder still count
+          PutBuiltChunks(pending_);
+        }
+
+        // insert in traversal order - keeps our output identical no matter who built what
+        staged_.clear();
+        staged_.resize(view_count);
+        for (size_t view = 0; view < view_count; view++) {
+          std::vector<PendingChunk>& drawn = drawn_[view];
+          for (auto& pending : drawn) {
+            std::shared_ptr<ChunkType> chunk;
+            if (pending.variant) {
+              continue;
+            }
 
-          vertex_data = (*itr)->vertex_data;
-          for (int i = 0; i < chunk_size; i++) {
-            *positions++ = vertex_data->position;
-            *normals++ = vertex_data->normal;
-            *texcoords++ = vertex_data->texcoord;
-            *tangents++ = vertex_data->tangent;
+            if (!pending.cached || !chunk_data_->Fetch(pending.identifier, &chunk)) {
+              // new, or evicted by an insert ahead of us
+              chunk_data_->Put(pending.identifier, pending.chunk);
+            }
+          }
 
-            vertex_data++;
-            vertices_drawn++;
+          // most recently used first, same as the cache
+          ViewOutput& output = staged_[view];
+          for (auto itr = drawn.rbegin(); itr != drawn.rend(); itr++) {
+            output.chunks.push_back(std::move(itr->chunk));
           }
 
-          n -= chunk_size;
+          output.complete = view_complete_[view];
+          drawn.clear();
         }
 
-        return vertices_drawn;
+        pending_.clear();
+        forced_.clear();
+        has_staged_ = true;
+        return true;
       }
 
-      size_t WriteIndexBuffer(void* dst, size_t n) {
-        unsigned int* ptr = reinterpret_cast<unsigned int*>(dst);
-        if (chunk_count_ <= 0) {
-          return 0;
+      // makes sure the cache holds at least this many of our chunks, on top of whatever others sharing it need
+      void ReserveChunks(size_t count) {
+        if (count > reserved_chunks_) {
+          chunk_data_->AddCapacity(count - reserved_chunks_);
+          reserved_chunks_ = count;
+        }
+      }
+
+      // when a budget runs out. max() if it doesn't
+      static std::chrono::steady_clock::time_point GetDeadline(const UpdateBudget* budget) {
+        if (budget == nullptr || budget->milliseconds <= 0.0) {
+          return std::chrono::steady_clock::time_point::max();
+        }
+
+        return std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+          std::chrono::duration<double, std::milli>(budget->milliseconds)
+        );
+      }
+
+      void PutBuiltChunks(const std::vector<PendingChunk>& chunks) {
+        for (auto& pending : chunks) {
+          if (!pending.cached && !pending.variant && pending.chunk) {
+            chunk_data_->Put(pending.identifier, pending.chunk);
+          }
+        }
+      }
+
+      // variants go in a cache of their own, keyed by how they're stitched
+      void PutBuiltVariants() {
+        for (size_t i = 0; i < pending_.size(); i++) {
+          const PendingChunk& pending = pending_[i];
+          if (!pending.variant || shared_[i] != i || !pending.chunk) {
+            continue;
+          }
+
+          StitchedChunkIdentifier identifier { pending.identifier, stitch_sizes_[i] };
+          std::shared_ptr<ChunkType> chunk;
+          if (!pending.cached || !variant_data_.Fetch(identifier, &chunk)) {
+            variant_data_.Put(identifier, pending.chunk);
+          }
+        }
+      }
+
+      // points each pending chunk at the first one with the same identifier and the same neighbour sizes - only that one gets built.
+      // the same leaf can border different sizes in different trees, and sharing it then would crack one of them
+      void FindSharedChunks(size_t view_count, size_t tree_res) {
+        shared_.resize(pending_.size());
+        for (size_t i = 0; i < pending_.size(); i++) {
+          shared_[i] = i;
+        }
+
+        if (view_count <= 1) {
+          // leaves of a single tree never overlap
+          return;
         }
 
-        size_t quad_size_bytes = 6 * sizeof(unsigned int);
-        size_t bytes_written = 0;
+        shared_index_.clear();
+        size_t variant_count = 0;
+        next_variant_.assign(pending_.size(), pending_.size());
+        stitch_loaded_.assign(pending_.size(), false);
+        stitch_sizes_.resize(std::max(stitch_sizes_.size(), pending_.size()));
+        for (size_t i = 0; i < pending_.size(); i++) {
+          const size_t first = shared_index_.emplace(pending_[i].identifier, i).first->second;
+          if (first == i) {
+            continue;
+          }
 
-        const size_t chunk_verts = (chunk_res_ + 1);
+          // only leaves in more than one view need their stitching checked
+          if (!stitch_loaded_[first]) {
+            LoadStitchSizes(first, tree_res);
+          }
 
-        size_t index_offset = 0;
-        size_t index_step = chunk_verts * chunk_verts;
-        for (int i = 0; i < chunk_count_; i++) {
-          for (int y = 0; y < chunk_res_; y++) {
-            for (int x = 0; x < chunk_res_; x++) {                        // ccw tris, bl -> tr
-              *(ptr++) = index_offset + (y       * chunk_verts) + x;      // bl
-              *(ptr++) = index_offset + (y       * chunk_verts) + x + 1;  // br
-              *(ptr++) = index_offset + ((y + 1) * chunk_verts) + x + 1;  // tr
-              *(ptr++) = index_offset + ((y + 1) * chunk_verts) + x + 1;  // tr
-              *(ptr++) = index_offset + ((y + 1) * chunk_verts) + x;      // tl
-              *(ptr++) = index_offset + (y       * chunk_verts) + x;      // bl
+          LoadStitchSizes(i, tree_res);
+          size_t candidate = first;
+          while (stitch_sizes_[candidate] != stitch_sizes_[i] && next_variant_[candidate] != pending_.size()) {
+            candidate = next_variant_[candidate];
+          }
 
-              bytes_written += quad_size_bytes;
-              if (bytes_written > (n - quad_size_bytes)) {
-                return bytes_written;
-              }
+          if (stitch_sizes_[candidate] == stitch_sizes_[i]) {
+            shared_[i] = candidate;
+            if (!pending_[candidate].variant) {
+              continue;
             }
+          } else {
+            // nobody stitches like us yet
+            next_variant_[candidate] = i;
+            variant_count++;
           }
 
-          index_offset += index_step;
+          // whatever the chunk cache has for this leaf was built for the first view
+          PendingChunk& pending = pending_[i];
+          pending.variant = true;
+          pending.chunk = nullptr;
+          pending.cached = (shared_[i] == i && variant_data_.Peek({ pending.identifier, stitch_sizes_[i] }, &pending.chunk));
         }
 
-        
+        // room for every variant we draw, so putting new ones only pushes out stale ones
+        variant_data_.Reserve(static_cast<int>(variant_count));
+      }
 
-        return bytes_written;
+      // neighbour sizes a pending chunk would be stitched against
+      void LoadStitchSizes(size_t index, size_t tree_res) {
+        const PendingChunk& pending = pending_[index];
+        neighbours_.Build(pending.tree, tree_res, pending.identifier.x, pending.identifier.y, pending.identifier.size, chunk_res_);
+        stitch_sizes_[index] = neighbours_.sizes;
+        stitch_loaded_[index] = true;
       }
 
-    private:
-      // builds chunks from an LOD tree recursively.
-      size_t UpdateChunks_recurse(
+      // fills cover with chunks covering a node, in draw order: leaves we have, else the nearest cached ancestor.
+      // returns false if some spot is left with neither - cover is partial in that case
+      bool CoverChunks_recurse(
         long offset_x,
         long offset_y,
         size_t chunk_size,
-        size_t tree_res,
         const lod::lod_node* node,
-        const lod::lod_node* tree,
-        VertexGenerator<HeightMap>& vert_gen
+        size_t* leaf,
+        std::vector<PendingChunk>* cover
       ) {
+        if (node->tl == nullptr) {
+          const PendingChunk& pending = pending_[(*leaf)++];
+          if (!pending.chunk) {
+            return false;
+          }
+
+          cover->push_back(pending);
+          return true;
+        }
+
+        const size_t first = cover->size();
+        long half_size = chunk_size >> 1;
+        bool covered = true;
+
+        // visit every child either way - leaf has to keep up with the traversal
+        covered &= CoverChunks_recurse(offset_x,             offset_y,             half_size, node->bl, leaf, cover);
+        covered &= CoverChunks_recurse(offset_x + half_size, offset_y,             half_size, node->br, leaf, cover);
+        covered &= CoverChunks_recurse(offset_x,             offset_y + half_size, half_size, node->tl, leaf, cover);
+        covered &= CoverChunks_recurse(offset_x + half_size, offset_y + half_size, half_size, node->tr, leaf, cover);
+        if (covered) {
+          return true;
+        }
+
+        PendingChunk self { { offset_x, offset_y, chunk_size }, nullptr, true, nullptr };
+        if (!chunk_data_->Peek(self.identifier, &self.chunk)) {
+          return false;
+        }
+
+        // we stand in for our whole subtree
+        cover->resize(first);
+        cover->push_back(std::move(self));
+        return true;
+      }
+
+      // lists leaves in draw order, picking up anything we have cached
+      void CollectChunks_recurse(long offset_x, long offset_y, size_t chunk_size, const lod::lod_node* node, const lod::lod_node* tree) {
         // if children are null, draw
         if (node->tl == nullptr) {
-          ChunkIdentifier identifier { offset_x, offset_y, chunk_size };
-          std::shared_ptr<Chunk> chunk;
-          if (!chunk_data_.Has(identifier)) {
-            chunk = Chunk::chunk_create(vert_gen, offset_x, offset_y, index_offset, chunk_size / chunk_res_, chunk_res_, tree);
-            chunk_data_.Put(identifier, chunk);
-          } else {
-            chunk_data_.Fetch(identifier, &chunk);
+          PendingChunk pending { { offset_x, offset_y, chunk_size }, nullptr, false, tree };
+          pending.cached = chunk_data_->Peek(pending.identifier, &pending.chunk);
+          pending_.push_back(std::move(pending));
+          return;
+        }
+
+        assert(node->tr != nullptr);
+        assert(node->bl != nullptr);
+        assert(node->br != nullptr);
+        long half_size = chunk_size >> 1;
+
+        CollectChunks_recurse(offset_x,             offset_y,             half_size, node->bl, tree);
+        CollectChunks_recurse(offset_x + half_size, offset_y,             half_size, node->br, tree);
+        CollectChunks_recurse(offset_x,             offset_y + half_size, half_size, node->tl, tree);
+        CollectChunks_recurse(offset_x + half_size, offset_y + half_size, half_size, node->tr, tree);
+      }
+
+      // lists pending chunks we don't have, nearest the observer first.
+      // without an observer, finer chunks go first - the tree only refines near the observer anyway
+      void FindMissingChunks(const glm::vec3* observers, size_t observer_count) {
+        missing_.clear();
+        for (size_t i = 0; i < pending_.size(); i++) {
+          if (!pending_[i].cached && shared_[i] == i) {
+            missing_.push_back(i);
           }
+        }
 
-          index_offset += chunk->vertex_count;
-          return 1;
-        } else {
-          assert(node->tr != nullptr);
-          assert(node->bl != nullptr);
-          assert(node->br != nullptr);
-          long half_size = chunk_size >> 1;
+        priority_.resize(pending_.size());
+        for (size_t i : missing_) {
+          const ChunkIdentifier& identifier = pending_[i].identifier;
+          float distance = 0.0f;
+          if (observers != nullptr) {
+            // same measure the tree splits on, to whoever's closest
+            float x = static_cast<float>(identifier.x);
+            float y = static_cast<float>(identifier.y);
+            float size = static_cast<float>(identifier.size);
+            distance = std::numeric_limits<float>::max();
+            for (size_t j = 0; j < observer_count; j++) {
+              const glm::vec3& observer = observers[j];
+              glm::vec3 closest_point(glm::clamp(observer.x, x, x + size), observer.y, glm::clamp(observer.z, y, y + size));
+              distance = std::min(distance, glm::length(closest_point - observer));
+            }
+          }
+
+          priority_[i] = { distance, identifier.size };
+        }
+
+        // stable, so ties keep draw order
+        std::stable_sort(missing_.begin(), missing_.end(), [this](size_t a, size_t b) {
+          return priority_[a] < priority_[b];
+        });
+      }
 
-          size_t chunk_count = 0;
-          chunk_count += UpdateChunks_recurse(offset_x,             offset_y,             half_size, tree_res, node->tl, tree, vert_gen);
-          chunk_count += UpdateChunks_recurse(offset_x + half_size, offset_y,             half_size, tree_res, node->tr, tree, vert_gen);
-          chunk_count += UpdateChunks_recurse(offset_x,             offset_y + half_size, half_size, tree_res, node->bl, tree, vert_gen);
-          chunk_count += UpdateChunks_recurse(offset_x + half_size, offset_y + half_size, half_size, tree_res, node->br, tree, vert_gen);
-          return chunk_count;
+      // builds the first [limit] chunks listed in missing_, in order, spread across our executor.
+      // nothing new is started past the deadline, though the first chunk always gets built.
+      // the chunk cache is only read from until we're done.
+      void GenerateChunks(
+        std::vector<PendingChunk>& jobs,
+        size_t limit,
+        std::chrono::steady_clock::time_point deadline,
+        size_t tree_res,
+        size_t node_count,
+        const std::atomic<bool>* cancel
+      ) {
+        limit = std::min(limit, missing_.size());
+        if (limit == 0) {
+          return;
+        }
+
+        // roughly two borders per chunk - bigger tables cost more in cache misses than they save
+        const size_t vertex_cache_size = node_count * 2 * (chunk_res_ + 1);
+        const size_t slot_count = std::min(std::max<size_t>(executor_->GetConcurrency(), 1), limit);
+        vertex_cache_.Reserve(vertex_cache_size);
+        while (workers_.size() + 1 < slot_count) {
+          workers_.emplace_back(new Worker());
         }
+
+        for (size_t i = 1; i < slot_count; i++) {
+          workers_[i - 1]->vertex_cache.Reserve(vertex_cache_size);
+        }
+
+        // one slot per thread that can run at once, each with its own scratch.
+        // slots pull chunks until there are none left, so a busy executor just leaves more for the rest
+        std::atomic<size_t> next_chunk(0);
+        executor_->ParallelFor(slot_count, [&](size_t slot) {
+          VertexCache* vertex_cache = (slot == 0 ? &vertex_cache_ : &workers_[slot - 1]->vertex_cache);
+          lod::lod_neighbours* neighbours = (slot == 0 ? &neighbours_ : &workers_[slot - 1]->neighbours);
+          VertexGenerator<HeightMap, Attributes, ChunkRes> gen(
+            height_,
+            horizontal_scale_,
+            texcoord_scale_,
+            chunk_res_,
+            tree_res,
+            terrain_offset_,
+            vertex_cache
+          );
+
+          gen.SetApproximateSampling(approximate_);
+          const bool timed = (deadline != std::chrono::steady_clock::time_point::max());
+          for (size_t i = next_chunk++; i < limit; i = next_chunk++) {
+            if (cancel != nullptr && cancel->load(std::memory_order_relaxed)) {
+              break;
+            }
+
+            if (timed && i > 0 && std::chrono::steady_clock::now() >= deadline) {
+              break;
+            }
+
+            PendingChunk& pending = jobs[missing_[i]];
+            pending.chunk = CreateChunk(pending.identifier, pending.tree, tree_res, gen, *neighbours);
+          }
+        });
+      }
+
+      // builds a single chunk. safe to call from several threads, given separate scratch.
+      std::shared_ptr<ChunkType> CreateChunk(
+        const ChunkIdentifier& identifier,
+        const lod::lod_node* tree,
+        size_t tree_res,
+        VertexGenerator<HeightMap, Attributes, ChunkRes>& vert_gen,
+        lod::lod_neighbours& neighbours
+      ) {
+        const size_t step = identifier.size / chunk_res_;
+        neighbours.Build(tree, tree_res, identifier.x, identifier.y, identifier.size, chunk_res_);
+        if constexpr ((Attributes & POSITION) != 0) {
+          std::shared_ptr<ChunkType> children[4];
+          if (GetCachedChildren(identifier, children)) {
+            // moving away - most of our samples are already here
+            return ChunkType::chunk_create_downsampled(vert_gen, identifier.x, identifier.y, step, chunk_res_, neighbours, children);
+          }
+        }
+
+        return ChunkType::chunk_create(vert_gen, identifier.x, identifier.y, 0, step, chunk_res_, neighbours);
+      }
+
+      // fetches bl, br, tl, tr children of a chunk if all of them are cached.
+      // leaves the cache order alone - children aren't part of the current chunk set.
+      bool GetCachedChildren(const ChunkIdentifier& identifier, std::shared_ptr<ChunkType> children[4]) {
+        if constexpr ((Attributes & POSITION) == 0) {
+          // no heights to reuse
+          return false;
+        }
+
+        if (identifier.size <= chunk_res_) {
+          // no such thing as a half step
+          return false;
+        }
+
+        long half_size = identifier.size >> 1;
+        for (int i = 0; i < 4; i++) {
+          ChunkIdentifier child { identifier.x + (i & 1) * half_size, identifier.y + (i >> 1) * half_size, static_cast<size_t>(half_size) };
+          if (!chunk_data_->Peek(child, &children[i])) {
+            return false;
+          }
+        }
+
+        return true;
       }
 
       int GetChunkCount_recurse(const lod::lod_node* node) {
@@ -227,18 +894,75 @@ namespace terraingen {
         return chunk_count;
       }
 
-      util::LRUCache<ChunkIdentifier, std::shared_ptr<Chunk>> chunk_data_;
-      // our chunks will be at the front of the 
+      std::shared_ptr<ChunkCache> chunk_data_;
+
+      // capacity we've added to chunk_data_. a private cache starts with what it was built with
+      size_t reserved_chunks_ = 256;
+
+      // chunks for leaves views stitch differently. only touched while staging
+      util::LRUCache<StitchedChunkIdentifier, std::shared_ptr<ChunkType>> variant_data_;
+
+      // border vertices, shared between neighboring chunks and across updates
+      VertexCache vertex_cache_;
 
       std::shared_ptr<HeightMap> height_;
       float horizontal_scale_;
       double texcoord_scale_;
       glm::vec3 terrain_offset_;
-      size_t chunk_res_;
+      util::StaticSize<ChunkRes> chunk_res_;
+
+      // chunk set our outputs read from. only ever swapped out whole, with atomic_store
+      std::shared_ptr<const Snapshot> published_;
+
+      // chunk set being built, one per view
+      std::vector<ViewOutput> staged_;
+
+      // how snapshots we publish write their buffers. replaced whole on change, never modified
+      std::shared_ptr<const WriteSettings> write_settings_;
+      bool has_staged_ = false;
+
+      // leaves of the current trees, in draw order, one tree after another
+      std::vector<PendingChunk> pending_;
+
+      // where each view's leaves start in pending_, plus one past the end
+      std::vector<size_t> view_begin_;
+
+      // pending chunk whose chunk we draw, for each pending chunk - ourselves, unless some earlier view has the same one
+      std::vector<size_t> shared_;
+      std::unordered_map<ChunkIdentifier, size_t> shared_index_;
+
+      // leaves in several views: the next differently stitched copy of each, and their neighbour sizes
+      std::vector<size_t> next_variant_;
+      std::vector<bool> stitch_loaded_;
+      std::vector<std::vector<size_t>> stitch_sizes_;
+
+      // nodes in the last tree we staged
+      size_t stage_node_count_ = 0;
+
+      // indices of pending chunks we have to build, in build order
+      std::vector<size_t> missing_;
+
+      // what each view draws, in draw order
+      std::vector<std::vector<PendingChunk>> drawn_;
+
+      // whether each view got every one of its leaves
+      std::vector<bool> view_complete_;
+
+      // root chunk, when a view has nothing better to draw
+      std::vector<PendingChunk> forced_;
+
+      // distance to observer, then chunk size, for each pending chunk
+      std::vector<std::pair<float, size_t>> priority_;
+
+      std::shared_ptr<util::Executor> executor_;
+
+      // scratch for slots past the first
+      std::vector<std::unique_ptr<Worker>> workers_;
 
-      size_t chunk_count_;
+      ApproximateSampling approximate_;
 
-      unsigned int index_offset;
+      // scratch for stitching info on the chunk being built
+      lod::lod_neighbours neighbours_;
     };  
   }
 }
@@ -1,7 +1,9 @@
 #ifndef CHUNK_IDENTIFIER_H_
 #define CHUNK_IDENTIFIER_H_
 
+#include <cstddef>
 #include <functional>
+#include <vector>
 
 namespace terraingen {
   namespace terrain {
@@ -14,6 +16,18 @@ namespace terraingen {
         return (rhs.x == x && rhs.y == y && rhs.size == size);
       }
     };
+
+    // a chunk built against particular neighbour sizes, for leaves which views stitch differently
+    struct StitchedChunkIdentifier {
+      ChunkIdentifier identifier;
+
+      // lod_neighbours::sizes the chunk was stitched against
+      std::vector<size_t> stitch_sizes;
+
+      bool operator==(const StitchedChunkIdentifier& rhs) const {
+        return (rhs.identifier == identifier && rhs.stitch_sizes == stitch_sizes);
+      }
+    };
   }
 }
 
@@ -25,6 +39,18 @@ namespace std {
       return ((identifier.x << 24) | identifier.y) * identifier.size;
     }
   };
+
+  template<>
+  struct hash<terraingen::terrain::StitchedChunkIdentifier> {
+    size_t operator()(const terraingen::terrain::StitchedChunkIdentifier& identifier) const {
+      size_t res = hash<terraingen::terrain::ChunkIdentifier>()(identifier.identifier);
+      for (size_t size : identifier.stitch_sizes) {
+        res = res * 31 + size;
+      }
+
+      return res;
+    }
+  };
 }
 
 #endif // CHUNK_IDENTIFIER_H_
\ No newline at end of file
@@ -0,0 +1,248 @@
+#ifndef CHUNK_SNAPSHOT_H_
+#define CHUNK_SNAPSHOT_H_
+
+#include "terrain/Chunk.hpp"
+#include "terrain/Vertex.hpp"
+#include "util/Executor.hpp"
+#include "util/StaticSize.hpp"
+#include "util/StreamCopy.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+namespace terraingen {
+  namespace terrain {
+    /**
+     * @brief A published chunk set. Never changes once built, so any number of threads can read it
+     *        while the generator works on the next one.
+     *        Chunks are held by reference - they stay alive as long as some snapshot still draws them,
+     *        even if the cache has let them go.
+     *
+     * @tparam Attributes - mask of VertexAttribute flags
+     * @tparam ChunkRes - chunk resolution, if known at compile time. 0 reads it at runtime.
+     */
+    template <unsigned int Attributes = ALL_ATTRIBUTES, size_t ChunkRes = 0>
+    class ChunkSnapshot {
+      typedef BasicChunk<Attributes> ChunkType;
+      typedef VertexFormat<Attributes> VertexType;
+    public:
+      // chunk set for one view
+      struct View {
+        // most recently used first, same as the cache
+        std::vector<std::shared_ptr<ChunkType>> chunks;
+
+        // draws the whole tree, no placeholders
+        bool complete = false;
+      };
+
+      /**
+       * @brief How buffers get written. Shared between every snapshot a generator publishes.
+       */
+      struct WriteSettings {
+        // splits writes up by chunk. null writes everything on the caller
+        std::shared_ptr<util::Executor> executor;
+
+        // one chunk's indices, starting at vertex 0. built on the fly if null
+        std::shared_ptr<const std::vector<unsigned int>> index_template;
+
+        // non-temporal stores, for mapped gpu memory we never read back
+        bool streaming = false;
+      };
+
+      ChunkSnapshot(size_t chunk_resolution) : chunk_res_(chunk_resolution) {}
+
+      ChunkSnapshot(std::vector<View>&& views, size_t chunk_resolution, std::shared_ptr<const WriteSettings> settings = nullptr)
+        : views_(std::move(views)),
+          chunk_res_(chunk_resolution),
+          settings_(std::move(settings)) {}
+
+      /**
+       * @brief Builds the indices for a single chunk - ccw tris, one quad after another, row by row.
+       * 
+       * @param chunk_resolution - number of quads along each axis
+       * @return std::vector<unsigned int> - chunk_resolution^2 * 6 indices
+       */
+      static std::vector<unsigned int> CreateIndexTemplate(size_t chunk_resolution) {
+        std::vector<unsigned int> indices;
+        indices.reserve(chunk_resolution * chunk_resolution * 6);
+        const unsigned int chunk_verts = static_cast<unsigned int>(chunk_resolution + 1);
+        for (unsigned int y = 0; y < chunk_resolution; y++) {
+          for (unsigned int x = 0; x < chunk_resolution; x++) {    // ccw tris, bl -> tr
+            indices.push_back((y       * chunk_verts) + x);        // bl
+            indices.push_back((y       * chunk_verts) + x + 1);    // br
+            indices.push_back(((y + 1) * chunk_verts) + x + 1);    // tr
+            indices.push_back(((y + 1) * chunk_verts) + x + 1);    // tr
+            indices.push_back(((y + 1) * chunk_verts) + x);        // tl
+            indices.push_back((y       * chunk_verts) + x);        // bl
+          }
+        }
+
+        return indices;
+      }
+
+      /**
+       * @return size_t - number of views in this chunk set
+       */
+      size_t GetViewCount() const {
+        return views_.size();
+      }
+
+      /**
+       * @param view - which view to check
+       * @return true if the view draws every leaf of its tree, rather than placeholders for some
+       */
+      bool IsComplete(size_t view = 0) const {
+        return (view < views_.size() && views_[view].complete);
+      }
+
+      // return number of chunks
+      size_t GetChunkCount(size_t view = 0) const {
+        return (view < views_.size() ? views_[view].chunks.size() : 0);
+      }
+
+      // return vertex buffer size in bytes
+      size_t GetVertexBufferSize(size_t view = 0) const {
+        return GetChunkCount(view) * (chunk_res_ + 1) * (chunk_res_ + 1) * sizeof(VertexType);
+      }
+
+      // return index buffer size in bytes
+      size_t GetIndexBufferSize(size_t view = 0) const {
+        return GetChunkCount(view) * chunk_res_ * chunk_res_ * 6 * sizeof(unsigned int);
+      }
+
+      // writers fill one chunk per task - every chunk lands at a fixed offset, so they can go in any order.
+      // whatever doesn't fit in the destination is left off the end
+
+      /**
+       * @brief Writes vertex buffer to destination
+       *
+       * @param dst - destination buffer
+       * @param n - number of bytes in destination buffer
+       * @param view - which view to write
+       * @return size_t - number of bytes written
+       */
+      size_t WriteVertexBuffer(void* dst, size_t n, size_t view = 0) const {
+        unsigned char* ptr = reinterpret_cast<unsigned char*>(dst);
+        const size_t chunk_size_bytes = (chunk_res_ + 1) * (chunk_res_ + 1) * sizeof(VertexType);
+        const size_t chunk_count = std::min(GetChunkCount(view), n / chunk_size_bytes);
+        if (chunk_count <= 0) {
+          return 0;
+        }
+
+        const auto& chunks = views_[view].chunks;
+        const bool streaming = (settings_ && settings_->streaming);
+        ForEachChunk(chunk_count, [&](size_t i) {
+          if (streaming) {
+            util::StreamCopy(ptr + i * chunk_size_bytes, chunks[i]->vertex_data, chunk_size_bytes);
+          } else {
+            memcpy(ptr + i * chunk_size_bytes, chunks[i]->vertex_data, chunk_size_bytes);
+          }
+        });
+
+        return chunk_count * chunk_size_bytes;
+      }
+
+      /**
+       * @brief Writes vertex buffer to separated attribute buffers.
+       *        Attributes outside of our mask are skipped, and their buffers may be null.
+       *
+       * @param positions - position output
+       * @param normals - normal output
+       * @param texcoords - texcoord output
+       * @param tangents - tangent output
+       * @param vertices - max number of vertices we can write across our attribute buffers
+       * @param view - which view to write
+       * @return size_t - number of vertices written
+       */
+      size_t WriteVertexBufferSeparate(glm::vec3* positions, glm::vec3* normals, glm::vec2* texcoords, glm::vec4* tangents, const size_t vertices, size_t view = 0) const {
+        const size_t chunk_size = (chunk_res_ + 1) * (chunk_res_ + 1);
+        const size_t chunk_count = std::min(GetChunkCount(view), vertices / chunk_size);
+        if (chunk_count <= 0) {
+          return 0;
+        }
+
+        const auto& chunks = views_[view].chunks;
+        ForEachChunk(chunk_count, [&](size_t i) {
+          const size_t first = i * chunk_size;
+          const VertexType* vertex_data = chunks[i]->vertex_data;
+          for (size_t v = 0; v < chunk_size; v++) {
+            if constexpr ((Attributes & POSITION) != 0) {
+              positions[first + v] = vertex_data->position;
+            }
+
+            if constexpr ((Attributes & NORMAL) != 0) {
+              normals[first + v] = vertex_data->normal;
+            }
+
+            if constexpr ((Attributes & TEXCOORD) != 0) {
+              texcoords[first + v] = vertex_data->texcoord;
+            }
+
+            if constexpr ((Attributes & TANGENT) != 0) {
+              tangents[first + v] = vertex_data->tangent;
+            }
+
+            vertex_data++;
+          }
+        });
+
+        return chunk_count * chunk_size;
+      }
+
+      size_t WriteIndexBuffer(void* dst, size_t n, size_t view = 0) const {
+        unsigned int* ptr = reinterpret_cast<unsigned int*>(dst);
+        const size_t quad_size_bytes = 6 * sizeof(unsigned int);
+        const size_t chunk_quads = chunk_res_ * chunk_res_;
+        const size_t quads = std::min(GetChunkCount(view) * chunk_quads, n / quad_size_bytes);
+        if (quads <= 0) {
+          return 0;
+        }
+
+        // every chunk's indices are the same, just offset by where its vertices start
+        std::shared_ptr<const std::vector<unsigned int>> index_template = (settings_ ? settings_->index_template : nullptr);
+        if (!index_template) {
+          index_template = std::make_shared<std::vector<unsigned int>>(CreateIndexTemplate(chunk_res_));
+        }
+
+        const unsigned int* indices = index_template->data();
+        const size_t chunk_indices = chunk_quads * 6;
+        const size_t index_step = (chunk_res_ + 1) * (chunk_res_ + 1);
+        const size_t total_indices = quads * 6;
+        const bool streaming = (settings_ && settings_->streaming);
+
+        // last chunk might only partly fit
+        ForEachChunk((quads + chunk_quads - 1) / chunk_quads, [&](size_t i) {
+          const size_t first = i * chunk_indices;
+          const size_t count = std::min(chunk_indices, total_indices - first);
+          util::CopyIndices(ptr + first, indices, count, static_cast<unsigned int>(i * index_step), streaming);
+        });
+
+        return quads * quad_size_bytes;
+      }
+
+    private:
+      std::vector<View> views_;
+      util::StaticSize<ChunkRes> chunk_res_;
+      std::shared_ptr<const WriteSettings> settings_;
+
+      template <typename Task>
+      void ForEachChunk(size_t count, Task&& task) const {
+        if (count > 1 && settings_ && settings_->executor && settings_->executor->GetConcurrency() > 1) {
+          settings_->executor->ParallelFor(count, task);
+        } else {
+          for (size_t i = 0; i < count; i++) {
+            task(i);
+          }
+        }
+      }
+    };
+  }
+}
+
+#endif // CHUNK_SNAPSHOT_H_
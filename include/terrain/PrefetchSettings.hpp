@@ -0,0 +1,23 @@
+#ifndef PREFETCH_SETTINGS_H_
+#define PREFETCH_SETTINGS_H_
+
+#include "terrain/UpdateBudget.hpp"
+
+#include <vector>
+
+namespace terraingen {
+  namespace terrain {
+    /**
+     * @brief Settings for building chunks ahead of a moving observer.
+     */
+    struct PrefetchSettings {
+      // how far ahead to predict, in whatever unit velocity is per. soonest first
+      std::vector<float> lookahead = { 1.0f };
+
+      // limits on building, shared by every predicted position
+      UpdateBudget budget;
+    };
+  }
+}
+
+#endif // PREFETCH_SETTINGS_H_
@@ -0,0 +1,21 @@
+#ifndef UPDATE_BUDGET_H_
+#define UPDATE_BUDGET_H_
+
+#include <cstddef>
+
+namespace terraingen {
+  namespace terrain {
+    /**
+     * @brief Caps how much building a single update does. Whatever doesn't fit is left for the next update.
+     */
+    struct UpdateBudget {
+      // stop starting new chunks after this long. 0 means no limit.
+      double milliseconds = 0.0;
+
+      // most new chunks to build. 0 means no limit.
+      size_t max_chunks = 0;
+    };
+  }
+}
+
+#endif // UPDATE_BUDGET_H_
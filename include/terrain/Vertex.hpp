@@ -11,7 +11,93 @@ namespace terraingen {
       glm::vec2 texcoord;
       glm::vec4 tangent;
     } __attribute__((aligned(4)));
+
+    /**
+     * @brief Flags for vertex attributes. Combine to pick which ones a generator computes and stores.
+     */
+    enum VertexAttribute : unsigned int {
+      POSITION = 1,
+      NORMAL = 2,
+      TEXCOORD = 4,
+      TANGENT = 8,
+
+      ALL_ATTRIBUTES = POSITION | NORMAL | TEXCOORD | TANGENT
+    };
+
+    namespace impl {
+      // one base per attribute - disabled ones are empty, and take up no space
+      template <bool Enabled> struct vertex_position {};
+      template <> struct vertex_position<true> { glm::vec3 position; };
+
+      template <bool Enabled> struct vertex_normal {};
+      template <> struct vertex_normal<true> { glm::vec3 normal; };
+
+      template <bool Enabled> struct vertex_texcoord {};
+      template <> struct vertex_texcoord<true> { glm::vec2 texcoord; };
+
+      template <bool Enabled> struct vertex_tangent {};
+      template <> struct vertex_tangent<true> { glm::vec4 tangent; };
+    }
+
+    /**
+     * @brief Vertex storing only the attributes in the mask, in Vertex's order.
+     *
+     * @tparam Attributes - mask of VertexAttribute flags
+     */
+    template <unsigned int Attributes>
+    struct PackedVertex
+      : impl::vertex_position<(Attributes & POSITION) != 0>,
+        impl::vertex_normal<(Attributes & NORMAL) != 0>,
+        impl::vertex_texcoord<(Attributes & TEXCOORD) != 0>,
+        impl::vertex_tangent<(Attributes & TANGENT) != 0> {};
+
+    namespace impl {
+      template <unsigned int Attributes>
+      struct vertex_format {
+        typedef PackedVertex<Attributes> type;
+      };
+
+      // full set is just a plain vertex
+      template <>
+      struct vertex_format<ALL_ATTRIBUTES> {
+        typedef Vertex type;
+      };
+    }
+
+    // storage type for a given attribute mask
+    template <unsigned int Attributes>
+    using VertexFormat = typename impl::vertex_format<Attributes>::type;
+
+    /**
+     * @brief Copies the attributes in the mask from a full vertex.
+     *
+     * @tparam Attributes - mask of VertexAttribute flags
+     * @param src - vertex to copy from
+     * @param dst - destination
+     */
+    template <unsigned int Attributes>
+    inline void StoreVertex(const Vertex& src, VertexFormat<Attributes>& dst) {
+      if constexpr ((Attributes & POSITION) != 0) {
+        dst.position = src.position;
+      }
+
+      if constexpr ((Attributes & NORMAL) != 0) {
+        dst.normal = src.normal;
+      }
+
+      if constexpr ((Attributes & TEXCOORD) != 0) {
+        dst.texcoord = src.texcoord;
+      }
+
+      if constexpr ((Attributes & TANGENT) != 0) {
+        dst.tangent = src.tangent;
+      }
+    }
+
+    static_assert(sizeof(VertexFormat<ALL_ATTRIBUTES>) == 48);
+    static_assert(sizeof(VertexFormat<POSITION>) == 12);
+    static_assert(sizeof(VertexFormat<POSITION | NORMAL | TEXCOORD>) == 32);
   }
 }
 
-#endif // VERTEX_H_
\ No newline at end of file
+#endif // VERTEX_H_
@@ -1,13 +1,25 @@
 #ifndef VERTEX_GENERATOR_H_
 #define VERTEX_GENERATOR_H_
 
+#include "terrain/ApproximateSampling.hpp"
 #include "terrain/Vertex.hpp"
+#include "terrain/VertexIdentifier.hpp"
+#include "terrain/VertexKernel.hpp"
+#include "util/DirectMappedCache.hpp"
+#include "util/StaticSize.hpp"
 #include "traits/height_map.hpp"
 
+#include "lod/lod_leaf_index.hpp"
 #include "lod/lod_node.hpp"
+#include "lod/lod_neighbours.hpp"
 
 #include <algorithm>
+#include <array>
+#include <cassert>
+#include <cmath>
 #include <memory>
+#include <type_traits>
+#include <vector>
 
 #include <glm/glm.hpp>
 #include <iostream>
@@ -19,16 +31,38 @@ namespace terraingen {
       
     }
 
-    template <typename HeightMap>
+    // stores vertices which border chunks might share
+    typedef util::DirectMappedCache<VertexIdentifier, Vertex> VertexCache;
+
+    /**
+     * @brief Creates vertices for chunks.
+     *
+     * @tparam HeightMap - format for height map
+     * @tparam Attributes - mask of VertexAttribute flags to compute
+     * @tparam ChunkRes - chunk resolution, if known at compile time. 0 reads it at runtime.
+     */
+    template <typename HeightMap, unsigned int Attributes = ALL_ATTRIBUTES, size_t ChunkRes = 0>
     class VertexGenerator {
       static_assert(traits::height_map<HeightMap>::value);
+      static_assert((Attributes & ALL_ATTRIBUTES) != 0);
+      static_assert((ChunkRes & (ChunkRes - 1)) == 0, "fixed chunk resolutions must be PoT");
+
+      // normals and tangents both come out of the same neighbor samples
+      static constexpr bool needs_frame = (Attributes & (NORMAL | TANGENT)) != 0;
     public:
+      // border normals blend with the vertex one step in, which reads one more step in
+      static constexpr size_t border_rings = 4;
+
       /**
        * @brief Construct a new Vertex Generator object
        * 
        * @param height - height map
        * @param horizontal_scale - ratio of world space : height space (ie how far apart samples are, as vertices)
        * @param texcoord_scale - ratio of world space : texcoord space (ie how far apart samples are, in tex space)
+       * @param chunk_resolution - number of quads along each chunk axis
+       * @param tree_resolution - size of the LOD tree
+       * @param terrain_offset - offset subtracted from all positions
+       * @param vertex_cache - optional cache for vertices along chunk borders. must outlive this generator.
        */
       VertexGenerator(
         std::shared_ptr<HeightMap> height,
@@ -36,39 +70,354 @@ namespace terraingen {
         double texcoord_scale,
         size_t chunk_resolution,
         size_t tree_resolution,
-        const glm::vec3& terrain_offset)
+        const glm::vec3& terrain_offset,
+        VertexCache* vertex_cache = nullptr)
         : height_map(height),
           scale(horizontal_scale),
           scale_tex(texcoord_scale),
           offset(terrain_offset),
           chunk_res(chunk_resolution),
-          tree_res(tree_resolution) {}
+          tree_res(tree_resolution),
+          vertex_cache_(vertex_cache),
+          grid_active_(false),
+          grid_exact_rings_(0) {}
+
+      /**
+       * @brief Samples a square grid of heights up front, so that subsequent vertex calls
+       *        read from it instead of polling the height map.
+       * 
+       * @param origin_x - x offset of the first grid sample
+       * @param origin_y - y offset of the first grid sample
+       * @param step - spacing between grid samples
+       * @param dim - number of samples along each axis
+       */
+      void LoadHeightGrid(long origin_x, long origin_y, size_t step, size_t dim) {
+        ResetHeightGrid(origin_x, origin_y, step, dim);
+        SampleHeightGrid(0, 0, dim, dim);
+        grid_exact_rings_ = dim;
+      }
+
+      /**
+       * @brief Samples the outer rings of a chunk's height grid - every height its border vertices read,
+       *        directly or through their neighbours. Call after ResetHeightGrid.
+       */
+      void SampleHeightGridBorder() {
+        const size_t dim = grid_dim_;
+        if (dim <= 2 * border_rings) {
+          SampleHeightGrid(0, 0, dim, dim);
+          grid_exact_rings_ = dim;
+          return;
+        }
+
+        SampleHeightGrid(0, 0, dim, border_rings);
+        SampleHeightGrid(0, dim - border_rings, dim, border_rings);
+        SampleHeightGrid(0, border_rings, border_rings, dim - 2 * border_rings);
+        SampleHeightGrid(dim - border_rings, border_rings, border_rings, dim - 2 * border_rings);
+        grid_exact_rings_ = border_rings;
+      }
+
+      /**
+       * @brief Sets when chunk height grids may be approximated. Off by default.
+       * 
+       * @param settings - approximation settings
+       */
+      void SetApproximateSampling(const ApproximateSampling& settings) {
+        assert(settings.lattice_step >= 2 && (settings.lattice_step & (settings.lattice_step - 1)) == 0);
+        approximate_ = settings;
+      }
+
+      /**
+       * @param step - distance between vertices in a chunk
+       * @return true if chunks with this step should be approximated
+       */
+      bool ShouldApproximate(size_t step) const {
+        return (approximate_.min_chunk_size != 0 && step * chunk_res >= approximate_.min_chunk_size);
+      }
+
+      /**
+       * @brief Loads a chunk's height grid, sampling its interior on a sparser lattice and interpolating the rest.
+       *        The border rings are sampled in full, so borders and their normals match fully sampled neighbours.
+       *        Every lattice cell is checked at its center, and we fall back to sampling everything
+       *        if any of them strays too far from the height map.
+       * 
+       * @param origin_x - x offset of the first grid sample
+       * @param origin_y - y offset of the first grid sample
+       * @param step - spacing between grid samples
+       * @param dim - number of samples along each axis
+       * @return true if the interpolated heights were kept
+       */
+      bool LoadHeightGridApproximate(long origin_x, long origin_y, size_t step, size_t dim) {
+        const size_t lattice = approximate_.lattice_step;
+
+        const size_t ring = border_rings;
+        if (dim < 2 * ring + lattice) {
+          // nothing much to skip
+          LoadHeightGrid(origin_x, origin_y, step, dim);
+          return false;
+        }
+
+        ResetHeightGrid(origin_x, origin_y, step, dim);
+        SampleHeightGridBorder();
+
+        // lattice starts on the innermost exact ring, and may run a little past the far one
+        const size_t first = ring - 1;
+        const size_t span = dim - 2 * first - 1;
+        const size_t count = (span + lattice - 1) / lattice + 1;
+        const long lattice_origin_x = origin_x + static_cast<long>(first * step);
+        const long lattice_origin_y = origin_y + static_cast<long>(first * step);
+        const long lattice_step = static_cast<long>(step * lattice);
+        lattice_.resize(count * count);
+        if constexpr (traits::height_map_region<HeightMap>::value) {
+          height_map->GetRegion(lattice_origin_x, lattice_origin_y, lattice_step, count, count, lattice_.data(), count);
+        } else {
+          for (long y = 0; y < static_cast<long>(count); y++) {
+            for (long x = 0; x < static_cast<long>(count); x++) {
+              lattice_[y * count + x] = height_map->Get(lattice_origin_x + x * lattice_step, lattice_origin_y + y * lattice_step);
+            }
+          }
+        }
+
+        // bilinear fill for the interior
+        const float inv_lattice = 1.0f / lattice;
+        for (size_t gy = ring; gy < dim - ring; gy++) {
+          size_t ly = (gy - first) / lattice;
+          float fy = ((gy - first) % lattice) * inv_lattice;
+          for (size_t gx = ring; gx < dim - ring; gx++) {
+            size_t lx = (gx - first) / lattice;
+            float fx = ((gx - first) % lattice) * inv_lattice;
+            const float* cell = &lattice_[ly * count + lx];
+            float bottom = cell[0] * (1.0f - fx) + cell[1] * fx;
+            float top = cell[count] * (1.0f - fx) + cell[count + 1] * fx;
+            height_grid_[gy * dim + gx] = bottom * (1.0f - fy) + top * fy;
+          }
+        }
+
+        // measure error at the center of every cell. centers sit on a lattice of their own, so sample them in one go.
+        // probes are exact, so keep them.
+        const size_t half = lattice / 2;
+        const size_t probe_count = count - 1;
+        probes_.resize(probe_count * probe_count);
+        const long probe_origin_x = lattice_origin_x + static_cast<long>(half * step);
+        const long probe_origin_y = lattice_origin_y + static_cast<long>(half * step);
+        if constexpr (traits::height_map_region<HeightMap>::value) {
+          height_map->GetRegion(probe_origin_x, probe_origin_y, lattice_step, probe_count, probe_count, probes_.data(), probe_count);
+        } else {
+          for (long y = 0; y < static_cast<long>(probe_count); y++) {
+            for (long x = 0; x < static_cast<long>(probe_count); x++) {
+              probes_[y * probe_count + x] = height_map->Get(probe_origin_x + x * lattice_step, probe_origin_y + y * lattice_step);
+            }
+          }
+        }
+
+        float error = 0.0f;
+        for (size_t py = 0; py < probe_count; py++) {
+          const size_t gy = first + py * lattice + half;
+          for (size_t px = 0; px < probe_count; px++) {
+            const size_t gx = first + px * lattice + half;
+            if (gx >= dim - ring || gy >= dim - ring) {
+              // cell runs past the interior - everything in it we keep is already exact
+              continue;
+            }
+
+            const float exact = probes_[py * probe_count + px];
+            float& approx = height_grid_[gy * dim + gx];
+            error = std::max(error, std::abs(exact - approx));
+            approx = exact;
+          }
+        }
 
+        if (error > approximate_.max_error) {
+          SampleHeightGrid(ring, ring, dim - 2 * ring, dim - 2 * ring);
+          grid_exact_rings_ = dim;
+          return false;
+        }
+
+        return true;
+      }
+
+      /**
+       * @brief Sets up a height grid without sampling it. Fill it in with SetGridHeight and SampleHeightGrid.
+       * 
+       * @param origin_x - x offset of the first grid sample
+       * @param origin_y - y offset of the first grid sample
+       * @param step - spacing between grid samples
+       * @param dim - number of samples along each axis
+       */
+      void ResetHeightGrid(long origin_x, long origin_y, size_t step, size_t dim) {
+        grid_origin_x_ = origin_x;
+        grid_origin_y_ = origin_y;
+        grid_step_ = step;
+        grid_dim_ = dim;
+        grid_exact_rings_ = 0;
+        if constexpr (ChunkRes == 0) {
+          height_grid_.resize(dim * dim);
+        } else {
+          assert(dim * dim <= height_grid_.size());
+        }
+
+        grid_active_ = true;
+      }
+
+      /**
+       * @brief Fills a rectangle of the height grid from the height map.
+       * 
+       * @param grid_x - first column, in grid samples
+       * @param grid_y - first row, in grid samples
+       * @param count_x - number of columns
+       * @param count_y - number of rows
+       */
+      void SampleHeightGrid(size_t grid_x, size_t grid_y, size_t count_x, size_t count_y) {
+        long step = static_cast<long>(grid_step_);
+        long sample_x = grid_origin_x_ + static_cast<long>(grid_x) * step;
+        long sample_y = grid_origin_y_ + static_cast<long>(grid_y) * step;
+
+        // row major, y outer
+        float* sample = &height_grid_[grid_y * grid_dim_ + grid_x];
+        if constexpr (traits::height_map_region<HeightMap>::value) {
+          height_map->GetRegion(sample_x, sample_y, step, count_x, count_y, sample, grid_dim_);
+        } else {
+          for (long y = 0; y < static_cast<long>(count_y); y++) {
+            for (long x = 0; x < static_cast<long>(count_x); x++) {
+              sample[y * grid_dim_ + x] = height_map->Get(sample_x + x * step, sample_y + y * step);
+            }
+          }
+        }
+      }
+
+      /**
+       * @brief Fills a single grid sample from a vertex built earlier at the same location.
+       * 
+       * @param grid_x - column, in grid samples
+       * @param grid_y - row, in grid samples
+       * @param vertex - vertex to read the height from
+       */
+      template <typename VertexType>
+      void SetGridHeight(size_t grid_x, size_t grid_y, const VertexType& vertex) {
+        height_grid_[grid_y * grid_dim_ + grid_x] = vertex.position.y + offset.y;
+      }
+
+      /**
+       * @brief Creates a run of interior vertices along x, reading heights from the loaded grid.
+       *        The grid must cover the run, plus one sample on every side.
+       * 
+       * @param offset_x - x offset of the first vertex
+       * @param offset_y - y offset of the row
+       * @param count - number of vertices to create
+       * @param output - attribute destinations
+       */
+      void CreateVertexRow(long offset_x, long offset_y, size_t count, const VertexStreams& output) {
+        assert(grid_active_);
+        long step = static_cast<long>(grid_step_);
+        long dim = static_cast<long>(grid_dim_);
+        long grid_x = (offset_x - grid_origin_x_) / step;
+        long grid_y = (offset_y - grid_origin_y_) / step;
+        assert(grid_x >= 1 && grid_x + static_cast<long>(count) < dim);
+        assert(grid_y >= 1 && grid_y + 1 < dim);
+
+        const float* row = &height_grid_[grid_y * dim + grid_x];
+        VertexRowInput input { row, row - dim, row + dim, offset_x, offset_y, step, count };
+        terrain::CreateVertexRow(input, scale, scale_tex, offset, output);
+      }
+
+      /**
+       * @brief Stops reading from the height grid. Storage is kept around for the next chunk.
+       */
+      void ClearHeightGrid() {
+        grid_active_ = false;
+      }
+
+      /**
+       * @brief Creates a vertex, stitching to neighboring chunks by walking the LOD tree.
+       * 
+       * @param offset_x - x offset for sample
+       * @param offset_y - y offset for sample
+       * @param step - distance between vertices in the chunk this vertex belongs to
+       * @param tree - root of our LOD tree
+       * @return Vertex - resultant vertex object.
+       */
       Vertex CreateVertex(
         long offset_x,
         long offset_y,
         size_t step,
         const lod::lod_node* tree
+      ) {
+        auto lookup = [&](long x, long y, int dir_x, int dir_y) {
+          return lod::lod_node::GetChunkSize(tree, tree_res, glm::vec2(x, y) + glm::vec2(0.5f * dir_x, 0.5f * dir_y));
+        };
+
+        return CreateVertex_lookup(offset_x, offset_y, step, lookup);
+      }
+
+      /**
+       * @brief Creates a vertex, stitching to neighboring chunks via a flat index of the tree's leaves.
+       *        Matches the tree walk, for vertices anywhere in the tree - use it when there's no single chunk to build a table for.
+       * 
+       * @param offset_x - x offset for sample
+       * @param offset_y - y offset for sample
+       * @param step - distance between vertices in the chunk this vertex belongs to
+       * @param index - leaves of our LOD tree
+       * @return Vertex - resultant vertex object.
+       */
+      Vertex CreateVertex(
+        long offset_x,
+        long offset_y,
+        size_t step,
+        const lod::lod_leaf_index& index
+      ) {
+        auto lookup = [&](long x, long y, int dir_x, int dir_y) {
+          return index.GetChunkSize(x, y, dir_x, dir_y);
+        };
+
+        return CreateVertex_lookup(offset_x, offset_y, step, lookup);
+      }
+
+      /**
+       * @brief Creates a vertex, stitching to neighboring chunks via a precomputed table.
+       *        The vertex must belong to the chunk the table was built for.
+       * 
+       * @param offset_x - x offset for sample
+       * @param offset_y - y offset for sample
+       * @param step - distance between vertices in the chunk this vertex belongs to
+       * @param neighbours - chunk sizes around this vertex's chunk
+       * @return Vertex - resultant vertex object.
+       */
+      Vertex CreateVertex(
+        long offset_x,
+        long offset_y,
+        size_t step,
+        const lod::lod_neighbours& neighbours
+      ) {
+        auto lookup = [&](long x, long y, int dir_x, int dir_y) {
+          return neighbours.GetChunkSize(x, y, dir_x, dir_y);
+        };
+
+        return CreateVertex_lookup(offset_x, offset_y, step, lookup);
+      }
+
+    private:
+      // lookup returns the size of the chunk at (x + dir_x / 2, y + dir_y / 2)
+      template <typename SizeLookup>
+      Vertex CreateVertex_lookup(
+        long offset_x,
+        long offset_y,
+        size_t step,
+        const SizeLookup& lookup
       ) {
         size_t chunk_size = chunk_res * step;
-        if (offset_x % chunk_size == 0 || offset_y % chunk_size == 0) {
+        if (Remainder(offset_x, chunk_size) == 0 || Remainder(offset_y, chunk_size) == 0) {
           // have to poll chunk axis
-          glm::vec2 axis_sample(offset_x, offset_y);
-          axis_sample -= glm::vec2(0.5);
-
-          size_t target_size = lod::lod_node::GetChunkSize(tree, tree_res, axis_sample);
+          size_t target_size = lookup(offset_x, offset_y, -1, -1);
           size_t effective_step = target_size / chunk_res;
 
-          axis_sample += glm::vec2(1.0);
-          target_size = lod::lod_node::GetChunkSize(tree, tree_res, axis_sample);
+          target_size = lookup(offset_x, offset_y, 1, 1);
           effective_step = std::max(effective_step, target_size / chunk_res);
 
-          if ((offset_x % effective_step) != 0 || (offset_y % effective_step) != 0) {
+          if (Remainder(offset_x, effective_step) != 0 || Remainder(offset_y, effective_step) != 0) {
             // interpolate between nearest reference points
             return CreateVertex_edge(offset_x, offset_y, effective_step);
           } else {
             // sample along both axes
-            return CreateVertex_corner(offset_x, offset_y, tree);
+            return CreateVertex_corner(offset_x, offset_y, lookup);
           }
         }
 
@@ -76,7 +425,6 @@ namespace terraingen {
         return CreateVertex_internal(offset_x, offset_y, step);
       }
 
-    private:
       /**
        * @brief Create a Vertex object for the specified location
        * 
@@ -90,6 +438,29 @@ namespace terraingen {
         long offset_y,
         size_t step
       ) {
+        if constexpr (!needs_frame) {
+          // no neighbors to sample
+          Vertex res {};
+          res.position = GetPosition(offset_x, offset_y);
+          res.texcoord = glm::vec2(offset_x * scale_tex, offset_y * scale_tex);
+          return res;
+        }
+
+        if constexpr (traits::height_map_gradient<HeightMap>::value) {
+          // one sample gets us everything
+          float grad_x, grad_y;
+          float sample = height_map->GetWithGradient(offset_x, offset_y, &grad_x, &grad_y);
+          glm::vec3 position = glm::vec3(offset_x * scale, sample, offset_y * scale) - offset;
+
+          auto tangent = glm::normalize(glm::vec3(scale, grad_x, 0.0f));
+          auto bitangent = glm::normalize(glm::vec3(0.0f, grad_y, scale));
+          auto normal = glm::cross(bitangent, tangent);
+
+          auto texcoord = glm::vec2(offset_x * scale_tex, offset_y * scale_tex);
+
+          return { position, normal, texcoord, glm::vec4(tangent, 1.0) };
+        }
+
         auto position = GetPosition(offset_x, offset_y);
         auto coord_l = GetPosition(offset_x - step, offset_y);
         auto coord_r = GetPosition(offset_x + step, offset_y);
@@ -105,6 +476,27 @@ namespace terraingen {
         return { position, normal, texcoord, glm::vec4(tangent, 1.0) };
       }
 
+      // CreateVertex_internal, through the vertex cache if we have one
+      Vertex CreateVertex_shared(
+        long offset_x,
+        long offset_y,
+        size_t step
+      ) {
+        if (vertex_cache_ == nullptr || GridCovers(offset_x, offset_y, step)) {
+          // cheaper to rebuild than to look up
+          return CreateVertex_internal(offset_x, offset_y, step);
+        }
+
+        VertexIdentifier identifier { offset_x, offset_y, step };
+        Vertex res;
+        if (!vertex_cache_->Fetch(identifier, &res)) {
+          res = CreateVertex_internal(offset_x, offset_y, step);
+          vertex_cache_->Put(identifier, res);
+        }
+
+        return res;
+      }
+
       Vertex CreateVertex_edge(
         long offset_x,
         long offset_y,
@@ -115,16 +507,16 @@ namespace terraingen {
         // we're not on a corner...
         // so the edge axis is the coord st (offset % step) == 0
         glm::ivec2 sample_point(offset_x, offset_y);
-        int axis = (offset_x % effective_step == 0 ? 1 : 0);
+        int axis = (Remainder(offset_x, effective_step) == 0 ? 1 : 0);
 
-        float mix = static_cast<float>(sample_point[axis] % effective_step) / effective_step;
-        sample_point[axis] -= sample_point[axis] % effective_step;
+        float mix = static_cast<float>(Remainder(sample_point[axis], effective_step)) / effective_step;
+        sample_point[axis] -= Remainder(sample_point[axis], effective_step);
 
-        // lots of seemingly wasted samples for corners and edges :(
-        Vertex vert_floor = CreateVertex_internal(sample_point.x, sample_point.y, effective_step);
+        // neighbors along the edge (and the chunk across it) share these
+        Vertex vert_floor = CreateVertex_shared(sample_point.x, sample_point.y, effective_step);
 
         sample_point[axis] += effective_step;
-        Vertex vert_ceil = CreateVertex_internal(sample_point.x, sample_point.y, effective_step);
+        Vertex vert_ceil = CreateVertex_shared(sample_point.x, sample_point.y, effective_step);
 
         Vertex res;
         res.position = vert_floor.position * (1.0f - mix) + vert_ceil.position * mix;
@@ -136,17 +528,29 @@ namespace terraingen {
         return res;
       }
 
+      template <typename SizeLookup>
       Vertex CreateVertex_corner(
-        size_t offset_x,
-        size_t offset_y,
-        const lod::lod_node* node
+        long offset_x,
+        long offset_y,
+        const SizeLookup& lookup
       ) {
-        // find our nearest control points via GetChunkSize
-        glm::vec2 test_point(offset_x, offset_y);
-        size_t step_bl = lod::lod_node::GetChunkSize(node, tree_res, test_point + glm::vec2(-0.5, -0.5)) / chunk_res;
-        size_t step_br = lod::lod_node::GetChunkSize(node, tree_res, test_point + glm::vec2(0.5, -0.5)) / chunk_res;
-        size_t step_tl = lod::lod_node::GetChunkSize(node, tree_res, test_point + glm::vec2(-0.5, 0.5)) / chunk_res;
-        size_t step_tr = lod::lod_node::GetChunkSize(node, tree_res, test_point + glm::vec2(0.5, 0.5)) / chunk_res;
+        if constexpr (!needs_frame) {
+          return CreateVertex_internal(offset_x, offset_y, 1);
+        }
+
+        if constexpr (traits::height_map_gradient<HeightMap>::value) {
+          // analytic normals already agree with every neighbor, regardless of their step
+          // normalized to match the blended output below
+          Vertex res = CreateVertex_internal(offset_x, offset_y, 1);
+          res.normal = glm::normalize(res.normal);
+          return res;
+        }
+
+        // find our nearest control points
+        size_t step_bl = lookup(offset_x, offset_y, -1, -1) / chunk_res;
+        size_t step_br = lookup(offset_x, offset_y, 1, -1) / chunk_res;
+        size_t step_tl = lookup(offset_x, offset_y, -1, 1) / chunk_res;
+        size_t step_tr = lookup(offset_x, offset_y, 1, 1) / chunk_res;
         
         size_t left_step = std::max(step_bl, step_tl);
         size_t right_step = std::max(step_br, step_tr);
@@ -168,10 +572,10 @@ namespace terraingen {
 
         // fetch our actual edge vertices, using steps calculated above
         // blend normals, tangents according to above calculati
-        Vertex left_vert = CreateVertex_internal(offset_x - left_step, offset_y, left_step);
-        Vertex right_vert = CreateVertex_internal(offset_x + right_step, offset_y, right_step);
-        Vertex top_vert = CreateVertex_internal(offset_x, offset_y + top_step, top_step);
-        Vertex bot_vert = CreateVertex_internal(offset_x, offset_y - bot_step, bot_step);
+        Vertex left_vert = CreateVertex_shared(offset_x - left_step, offset_y, left_step);
+        Vertex right_vert = CreateVertex_shared(offset_x + right_step, offset_y, right_step);
+        Vertex top_vert = CreateVertex_shared(offset_x, offset_y + top_step, top_step);
+        Vertex bot_vert = CreateVertex_shared(offset_x, offset_y - bot_step, bot_step);
 
         Vertex res;
         // position + texcoord we can set trivially
@@ -204,11 +608,85 @@ namespace terraingen {
       float scale_tex;
       glm::vec3 offset;
 
-      size_t chunk_res;
+      util::StaticSize<ChunkRes> chunk_res;
       size_t tree_res;
 
+      VertexCache* vertex_cache_;
+
+      // scratch grid for the chunk currently being built
+      // sized up front when our resolution is fixed
+      typename std::conditional<
+        ChunkRes == 0,
+        std::vector<float>,
+        std::array<float, (ChunkRes + 3) * (ChunkRes + 3)>
+      >::type height_grid_;
+      long grid_origin_x_;
+      long grid_origin_y_;
+      size_t grid_step_;
+      size_t grid_dim_;
+      bool grid_active_;
+
+      // rings (from the outside in) of the grid which match the height map exactly
+      size_t grid_exact_rings_;
+
+      // sparse samples for approximated grids
+      ApproximateSampling approximate_;
+      std::vector<float> lattice_;
+      std::vector<float> probes_;
+
+      // true if every sample CreateVertex_internal would take lies on the height grid
+      bool GridCovers(long offset_x, long offset_y, size_t step) {
+        if (!grid_active_ || step != grid_step_) {
+          return false;
+        }
+
+        long grid_x = offset_x - grid_origin_x_;
+        long grid_y = offset_y - grid_origin_y_;
+        long mask = static_cast<long>(grid_step_) - 1;
+        if (((grid_x | grid_y) & mask) != 0) {
+          return false;
+        }
+
+        grid_x /= static_cast<long>(grid_step_);
+        grid_y /= static_cast<long>(grid_step_);
+        long dim = static_cast<long>(grid_dim_);
+        return (grid_x >= 1 && grid_x + 1 < dim && grid_y >= 1 && grid_y + 1 < dim);
+      }
+
+      // x % size, for sizes built from our (PoT) steps. a mask when the resolution is fixed.
+      size_t Remainder(long x, size_t size) const {
+        if constexpr (ChunkRes != 0) {
+          return static_cast<size_t>(x) & (size - 1);
+        } else {
+          return static_cast<size_t>(x) % size;
+        }
+      }
+
+      float GetHeight(long offset_x, long offset_y) {
+        if (grid_active_) {
+          long grid_x = offset_x - grid_origin_x_;
+          long grid_y = offset_y - grid_origin_y_;
+          // steps are always PoT
+          long mask = static_cast<long>(grid_step_) - 1;
+          if (((grid_x | grid_y) & mask) == 0) {
+            grid_x /= static_cast<long>(grid_step_);
+            grid_y /= static_cast<long>(grid_step_);
+            long dim = static_cast<long>(grid_dim_);
+            if (grid_x >= 0 && grid_x < dim && grid_y >= 0 && grid_y < dim) {
+              // vertices outside the grid get cached, so only trust heights straight from the map
+              long ring = std::min(std::min(grid_x, grid_y), std::min(dim - 1 - grid_x, dim - 1 - grid_y));
+              if (ring < static_cast<long>(grid_exact_rings_)) {
+                return height_grid_[grid_y * dim + grid_x];
+              }
+            }
+          }
+        }
+
+        return height_map->Get(offset_x, offset_y);
+      }
+
       glm::vec3 GetPosition(long offset_x, long offset_y) {
-        float sample = height_map->Get(offset_x, offset_y);
+        float sample = GetHeight(offset_x, offset_y);
         glm::vec3 position(offset_x * scale, sample, offset_y * scale);
         position -= offset;
         return position;
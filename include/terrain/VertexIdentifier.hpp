@@ -0,0 +1,35 @@
+#ifndef VERTEX_IDENTIFIER_H_
+#define VERTEX_IDENTIFIER_H_
+
+#include <cstddef>
+#include <functional>
+
+namespace terraingen {
+  namespace terrain {
+    // identifies a vertex built at some location, with some step between samples
+    struct VertexIdentifier {
+      long x;
+      long y;
+      size_t step;
+
+      bool operator==(const VertexIdentifier& rhs) const {
+        return (rhs.x == x && rhs.y == y && rhs.step == step);
+      }
+    };
+  }
+}
+
+namespace std {
+  template<>
+  struct hash<terraingen::terrain::VertexIdentifier> {
+    size_t operator()(const terraingen::terrain::VertexIdentifier& identifier) const {
+      // neighbors differ in low bits, so mix a bit more than ChunkIdentifier does
+      size_t res = static_cast<size_t>(identifier.x) * 0x9E3779B97F4A7C15ull;
+      res ^= static_cast<size_t>(identifier.y) + 0x7F4A7C159E3779B9ull + (res << 6) + (res >> 2);
+      res ^= identifier.step + (res << 6) + (res >> 2);
+      return res;
+    }
+  };
+}
+
+#endif // VERTEX_IDENTIFIER_H_
@@ -0,0 +1,97 @@
+#ifndef VERTEX_KERNEL_H_
+#define VERTEX_KERNEL_H_
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+
+// vectorized vertex construction for runs of interior vertices
+namespace terraingen {
+  namespace terrain {
+    enum SimdLevel {
+      // plain scalar code
+      SCALAR,
+
+      // 4 lanes
+      SSE,
+
+      // 8 lanes
+      AVX2
+    };
+
+    /**
+     * @brief Heights for a single row of vertices (constant y, increasing x)
+     */
+    struct VertexRowInput {
+      // heights along the row. heights[-1] and heights[count] must be readable.
+      const float* heights;
+
+      // heights one step below the row
+      const float* heights_down;
+
+      // heights one step above the row
+      const float* heights_up;
+
+      // sample coordinates of the first vertex
+      long offset_x;
+      long offset_y;
+
+      // distance between samples
+      long step;
+
+      // number of vertices in the row
+      size_t count;
+    };
+
+    /**
+     * @brief Destinations for each vertex attribute. Null streams are skipped.
+     */
+    struct VertexStreams {
+      glm::vec3* position;
+      glm::vec3* normal;
+      glm::vec2* texcoord;
+      glm::vec4* tangent;
+
+      // distance between consecutive vertices, in bytes
+      size_t stride;
+    };
+
+    /**
+     * @return SimdLevel - widest kernel supported by the running cpu
+     */
+    SimdLevel GetSimdLevel();
+
+    /**
+     * @brief Builds a row of vertices from pre-sampled heights.
+     *        Matches VertexGenerator's per-vertex output.
+     *
+     * @param input - heights for the row
+     * @param scale - ratio of world space : height space
+     * @param scale_tex - ratio of world space : texcoord space
+     * @param offset - terrain offset, subtracted from positions
+     * @param output - attribute destinations
+     * @param level - kernel to run. clamped to what the cpu supports
+     */
+    void CreateVertexRow(
+      const VertexRowInput& input,
+      float scale,
+      float scale_tex,
+      const glm::vec3& offset,
+      const VertexStreams& output,
+      SimdLevel level
+    );
+
+    /**
+     * @brief Builds a row of vertices, using the widest supported kernel.
+     */
+    void CreateVertexRow(
+      const VertexRowInput& input,
+      float scale,
+      float scale_tex,
+      const glm::vec3& offset,
+      const VertexStreams& output
+    );
+  }
+}
+
+#endif // VERTEX_KERNEL_H_
@@ -1,7 +1,9 @@
 #ifndef HEIGHT_MAP_H_
 #define HEIGHT_MAP_H_
 
+#include <cstddef>
 #include <type_traits>
+#include <utility>
 
 // going with git in submodule for now
 // if i get screwed over when it comes time to negotiate dependencies i'll figure it out (it would happen anyway i think)
@@ -17,10 +19,45 @@ namespace terraingen {
         template <typename MapType, typename...>
         static std::false_type test(...);
       };
+
+      struct height_map_region_impl {
+        template <typename MapType,
+        typename Sample = decltype(std::declval<MapType&>().GetRegion((int)0, (int)0, (int)0, (int)0, (int)0, (float*)nullptr, (size_t)0))>
+        static std::true_type test(int);
+
+        template <typename MapType, typename...>
+        static std::false_type test(...);
+      };
+
+      struct height_map_gradient_impl {
+        template <typename MapType,
+        typename Sample = std::is_same<float, decltype(std::declval<MapType&>().GetWithGradient((int)0, (int)0, (float*)nullptr, (float*)nullptr))>>
+        static std::true_type test(int);
+
+        template <typename MapType, typename...>
+        static std::false_type test(...);
+      };
     }
 
     template <typename T>
     struct height_map : decltype(impl_::height_map_impl::test<T>(0)) {};
+
+    /**
+     * @brief Optional batched sampling for height maps.
+     *        Detects `void GetRegion(int x, int y, int step, int count_x, int count_y, float* output, size_t stride)`,
+     *        which should fill `output[j * stride + i]` with `Get(x + i * step, y + j * step)`.
+     *        Rows are `count_x` samples wide, `stride` floats apart. A single row is just `count_y == 1`.
+     */
+    template <typename T>
+    struct height_map_region : decltype(impl_::height_map_region_impl::test<T>(0)) {};
+
+    /**
+     * @brief Optional analytic derivatives for height maps.
+     *        Detects `float GetWithGradient(int x, int y, float* grad_x, float* grad_y)`,
+     *        which returns `Get(x, y)` and writes the change in height per sample along x and y.
+     */
+    template <typename T>
+    struct height_map_gradient : decltype(impl_::height_map_gradient_impl::test<T>(0)) {};
   }
 }
 
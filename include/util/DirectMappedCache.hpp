@@ -0,0 +1,106 @@
+#ifndef DIRECT_MAPPED_CACHE_H_
+#define DIRECT_MAPPED_CACHE_H_
+
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+namespace terraingen {
+  namespace util {
+
+    // fixed size, no allocations after construction
+    // each key maps to exactly one slot - a colliding put just replaces what was there
+    // good for lots of tiny values where an LRUCache would spend more time on bookkeeping than it saves
+
+    /**
+     * @brief direct mapped cache impl
+     * 
+     * @tparam KeyType - type for key
+     * @tparam ValueType - type for value
+     */
+    template <typename KeyType, typename ValueType>
+    class DirectMappedCache {
+    public:
+      DirectMappedCache(size_t capacity) {
+        Resize(capacity);
+      }
+
+      bool Fetch(const KeyType& key, ValueType* output) {
+        const Slot& slot = slots_[SlotIndex(key)];
+        if (slot.valid && slot.key == key) {
+          *output = slot.value;
+          return true;
+        }
+
+        return false;
+      }
+
+      bool Has(const KeyType& key) {
+        const Slot& slot = slots_[SlotIndex(key)];
+        return (slot.valid && slot.key == key);
+      }
+
+      // overwrites anything sharing this key's slot
+      void Put(const KeyType& key, const ValueType& value) {
+        Slot& slot = slots_[SlotIndex(key)];
+        slot.key = key;
+        slot.value = value;
+        slot.valid = true;
+      }
+
+      /**
+       * @brief ensure cache has at least the specified number of slots.
+       *        growing drops everything stored so far.
+       * 
+       * @param new_capacity 
+       */
+      void Reserve(size_t new_capacity) {
+        if (slots_.size() < new_capacity) {
+          Resize(new_capacity);
+        }
+      }
+
+      // drops everything
+      void Clear() {
+        for (auto& slot : slots_) {
+          slot.valid = false;
+        }
+      }
+
+      size_t Capacity() {
+        return slots_.size();
+      }
+
+    private:
+      struct Slot {
+        KeyType key;
+        ValueType value;
+        bool valid;
+      };
+
+      void Resize(size_t capacity) {
+        // PoT so we can mask
+        size_t size = 1;
+        while (size < capacity) {
+          size <<= 1;
+        }
+
+        slots_.assign(size, Slot());
+        for (auto& slot : slots_) {
+          slot.valid = false;
+        }
+
+        mask_ = size - 1;
+      }
+
+      size_t SlotIndex(const KeyType& key) {
+        return std::hash<KeyType>()(key) & mask_;
+      }
+
+      std::vector<Slot> slots_;
+      size_t mask_;
+    };
+  }
+}
+
+#endif // DIRECT_MAPPED_CACHE_H_
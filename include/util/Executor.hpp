@@ -0,0 +1,110 @@
+#ifndef EXECUTOR_H_
+#define EXECUTOR_H_
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+
+namespace terraingen {
+  namespace util {
+
+    // everything we run off the calling thread goes through one of these
+    // wrap your engine's job system in one, so terrain work shares its threads instead of fighting them
+
+    /**
+     * @brief runs tasks for us
+     */
+    class Executor {
+    public:
+      virtual ~Executor() = default;
+
+      /**
+       * @brief Queues a task to run at some point. Free to run it right away, on the calling thread.
+       * 
+       * @param task - task to run
+       */
+      virtual void Submit(std::function<void()> task) = 0;
+
+      /**
+       * @return size_t - how many tasks can run at once, counting a thread waiting in ParallelFor
+       */
+      virtual size_t GetConcurrency() const = 0;
+
+      /**
+       * @brief Runs task(i) for every i in [0, count), and returns once they're all done.
+       *        The caller runs tasks as well, so this is safe to call from inside a task.
+       *        Override to hand the whole loop to a native parallel for.
+       * 
+       * @param count - number of indices
+       * @param task - task to run for each index
+       */
+      virtual void ParallelFor(size_t count, const std::function<void(size_t)>& task) {
+        if (count == 0) {
+          return;
+        }
+
+        // helpers can start after we return - they only hold on to this, and touch task for indices they claim
+        struct State {
+          std::atomic<size_t> next { 0 };
+          size_t done = 0;
+          std::mutex lock;
+          std::condition_variable cond;
+        };
+
+        auto state = std::make_shared<State>();
+        const std::function<void(size_t)>* body = &task;
+        auto run = [state, body, count]() {
+          size_t finished = 0;
+          for (size_t i = state->next++; i < count; i = state->next++) {
+            (*body)(i);
+            finished++;
+          }
+
+          if (finished > 0) {
+            std::lock_guard<std::mutex> lock(state->lock);
+            state->done += finished;
+            if (state->done == count) {
+              state->cond.notify_all();
+            }
+          }
+        };
+
+        const size_t helpers = std::min(std::max<size_t>(GetConcurrency(), 1), count) - 1;
+        for (size_t i = 0; i < helpers; i++) {
+          Submit(run);
+        }
+
+        run();
+
+        std::unique_lock<std::mutex> lock(state->lock);
+        state->cond.wait(lock, [&] { return state->done == count; });
+      }
+    };
+
+    /**
+     * @brief runs everything on the calling thread
+     */
+    class InlineExecutor : public Executor {
+    public:
+      void Submit(std::function<void()> task) override {
+        task();
+      }
+
+      size_t GetConcurrency() const override {
+        return 1;
+      }
+
+      void ParallelFor(size_t count, const std::function<void(size_t)>& task) override {
+        for (size_t i = 0; i < count; i++) {
+          task(i);
+        }
+      }
+    };
+  }
+}
+
+#endif // EXECUTOR_H_
@@ -1,6 +1,7 @@
 #ifndef HASH_LIST_H_
 #define HASH_LIST_H_
 
+#include <cassert>
 #include <unordered_map>
 
 #include "util/impl/ListNode.hpp"
@@ -1,6 +1,7 @@
 #ifndef LRU_CACHE_H_
 #define LRU_CACHE_H_
 
+#include <cassert>
 #include <list>
 #include <unordered_map>
 
@@ -46,6 +47,17 @@ namespace terraingen {
         return false;
       }
 
+      // fetch without counting as a use
+      bool Peek(const KeyType& key, ValueType* output) {
+        auto itr = value_cache.find(key);
+        if (itr != value_cache.end()) {
+          *output = itr->second;
+          return true;
+        }
+
+        return false;
+      }
+
       bool Has(const KeyType& key) {
         return (key_cache.Contains(key));
       }
@@ -91,6 +103,8 @@ namespace terraingen {
           if (output != nullptr) {
             *output = value_cache.at(key_last);
           }
+
+          value_cache.erase(key_last);
           res = REMOVE_LAST;
         }
 
@@ -0,0 +1,139 @@
+#ifndef SHARDED_LRU_CACHE_H_
+#define SHARDED_LRU_CACHE_H_
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+
+#include "util/LRUCache.hpp"
+
+namespace terraingen {
+  namespace util {
+
+    // a fixed number of LRU caches, each behind its own lock. keys are spread between them by hash.
+    // recency is tracked per shard, so eviction is only roughly LRU across the whole thing -
+    // in exchange, threads touching different shards never wait on each other.
+
+    /**
+     * @brief thread safe LRU cache
+     * 
+     * @tparam KeyType - type for key. needs a std::hash
+     * @tparam ValueType - type for value
+     * @tparam ShardCount - number of independently locked shards
+     */
+    template <typename KeyType, typename ValueType, size_t ShardCount = 16>
+    class ShardedLRUCache {
+      static_assert(ShardCount > 0);
+    public:
+      ShardedLRUCache(size_t capacity) : capacity_(0) {
+        Reserve(capacity);
+      }
+
+      ShardedLRUCache(const ShardedLRUCache&) = delete;
+      ShardedLRUCache& operator=(const ShardedLRUCache&) = delete;
+
+      bool Fetch(const KeyType& key, ValueType* output) {
+        Shard& shard = GetShard(key);
+        std::lock_guard<std::mutex> lock(shard.lock);
+        return shard.cache.Fetch(key, output);
+      }
+
+      // fetch without counting as a use
+      bool Peek(const KeyType& key, ValueType* output) {
+        Shard& shard = GetShard(key);
+        std::lock_guard<std::mutex> lock(shard.lock);
+        return shard.cache.Peek(key, output);
+      }
+
+      bool Has(const KeyType& key) {
+        Shard& shard = GetShard(key);
+        std::lock_guard<std::mutex> lock(shard.lock);
+        return shard.cache.Has(key);
+      }
+
+      // put, ignore result
+      void Put(const KeyType& key, const ValueType& value) {
+        Put(key, value, nullptr);
+      }
+
+      // output receives booted out value - from this key's shard
+      CachePutResult Put(const KeyType& key, const ValueType& value, ValueType* output) {
+        Shard& shard = GetShard(key);
+        std::lock_guard<std::mutex> lock(shard.lock);
+        return shard.cache.Put(key, value, output);
+      }
+
+      /**
+       * @brief ensure cache has capacity for specified items, in total
+       * 
+       * @param new_capacity 
+       */
+      void Reserve(size_t new_capacity) {
+        std::lock_guard<std::mutex> lock(capacity_lock_);
+        if (capacity_ < new_capacity) {
+          SetCapacity(new_capacity);
+        }
+      }
+
+      /**
+       * @brief grows capacity by some number of items - for sharing a cache, where each user adds what it needs
+       * 
+       * @param extra_capacity 
+       */
+      void AddCapacity(size_t extra_capacity) {
+        std::lock_guard<std::mutex> lock(capacity_lock_);
+        SetCapacity(capacity_ + extra_capacity);
+      }
+
+      size_t Capacity() {
+        std::lock_guard<std::mutex> lock(capacity_lock_);
+        return capacity_;
+      }
+
+    private:
+      struct Shard {
+        Shard() : cache(0) {}
+
+        std::mutex lock;
+        LRUCache<KeyType, ValueType> cache;
+      };
+
+      // call with capacity_lock_ held
+      void SetCapacity(size_t capacity) {
+        capacity_ = capacity;
+
+        // a little slack per shard - keys never spread perfectly evenly
+        size_t shard_capacity = (capacity + ShardCount - 1) / ShardCount;
+        if (ShardCount > 1) {
+          shard_capacity += shard_capacity / 4 + 1;
+        }
+
+        for (Shard& shard : shards_) {
+          std::lock_guard<std::mutex> lock(shard.lock);
+          shard.cache.Reserve(static_cast<int>(shard_capacity));
+        }
+      }
+
+      Shard& GetShard(const KeyType& key) {
+        // hashes here can be pretty regular (chunk coordinates are all multiples of a power of two),
+        // so scramble them before picking a shard
+        uint64_t hash = static_cast<uint64_t>(std::hash<KeyType>()(key));
+        hash ^= hash >> 33;
+        hash *= 0xff51afd7ed558ccdull;
+        hash ^= hash >> 33;
+        hash *= 0xc4ceb9fe1a85ec53ull;
+        hash ^= hash >> 33;
+        return shards_[hash % ShardCount];
+      }
+
+      std::array<Shard, ShardCount> shards_;
+
+      std::mutex capacity_lock_;
+      size_t capacity_;
+    };
+  }
+}
+
+#endif // SHARDED_LRU_CACHE_H_
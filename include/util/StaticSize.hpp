@@ -0,0 +1,41 @@
+#ifndef STATIC_SIZE_H_
+#define STATIC_SIZE_H_
+
+#include <cstddef>
+
+namespace terraingen {
+  namespace util {
+
+    // a size which is either baked in at compile time, or held at runtime
+    // reads like a size_t either way, so arithmetic on a fixed one folds down to constants
+
+    /**
+     * @brief size known at compile time
+     *
+     * @tparam N - the size. 0 stores it at runtime instead.
+     */
+    template <size_t N>
+    struct StaticSize {
+      // value is ignored - anything taking a runtime size alongside N checks they match up front
+      explicit StaticSize(size_t) {}
+
+      constexpr operator size_t() const {
+        return N;
+      }
+    };
+
+    template <>
+    struct StaticSize<0> {
+      explicit StaticSize(size_t value) : value_(value) {}
+
+      operator size_t() const {
+        return value_;
+      }
+
+    private:
+      size_t value_;
+    };
+  }
+}
+
+#endif // STATIC_SIZE_H_
@@ -0,0 +1,36 @@
+#ifndef STREAM_COPY_H_
+#define STREAM_COPY_H_
+
+#include <cstddef>
+
+namespace terraingen {
+  namespace util {
+
+    // copies for buffers we write once and never read back - mapped gpu staging memory, mostly.
+    // non-temporal stores skip the cache, so a big upload doesn't flush everything else out of it,
+    // and write-combined memory gets whole lines at a time.
+    // into ordinary memory you're about to read, plain memcpy is faster.
+
+    /**
+     * @brief memcpy, with non-temporal stores where the cpu has them. Stores are fenced before returning.
+     * 
+     * @param dst - destination
+     * @param src - source. must not overlap dst
+     * @param bytes - number of bytes to copy
+     */
+    void StreamCopy(void* dst, const void* src, size_t bytes);
+
+    /**
+     * @brief Copies indices, adding an offset to each one.
+     * 
+     * @param dst - destination
+     * @param src - source indices. must not overlap dst
+     * @param count - number of indices
+     * @param offset - added to every index
+     * @param streaming - use non-temporal stores where the cpu has them
+     */
+    void CopyIndices(unsigned int* dst, const unsigned int* src, size_t count, unsigned int offset, bool streaming);
+  }
+}
+
+#endif // STREAM_COPY_H_
@@ -0,0 +1,70 @@
+#ifndef WORK_STEALING_POOL_H_
+#define WORK_STEALING_POOL_H_
+
+#include "util/Executor.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace terraingen {
+  namespace util {
+
+    // each worker owns a queue, and works through it newest first
+    // out of work, it steals the oldest task off someone else's queue
+    // tasks submitted from a worker land on its own queue, so nested parallel fors stay local
+
+    /**
+     * @brief executor for anyone without a job system of their own
+     */
+    class WorkStealingPool : public Executor {
+    public:
+      /**
+       * @param threads - number of worker threads. 0 runs every task on whoever submits it.
+       */
+      explicit WorkStealingPool(size_t threads);
+
+      // finishes everything queued before returning
+      ~WorkStealingPool();
+
+      WorkStealingPool(const WorkStealingPool&) = delete;
+      WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+      void Submit(std::function<void()> task) override;
+
+      // workers, plus the thread waiting on them
+      size_t GetConcurrency() const override;
+
+    private:
+      struct Queue {
+        std::mutex lock;
+        std::deque<std::function<void()>> tasks;
+      };
+
+      void WorkerLoop(size_t index);
+
+      // newest task on our own queue, or the oldest on anyone else's
+      bool TakeTask(size_t index, std::function<void()>* task);
+
+      std::vector<std::unique_ptr<Queue>> queues_;
+      std::vector<std::thread> threads_;
+
+      // spreads submissions from outside the pool
+      std::atomic<size_t> next_queue_;
+
+      // tasks sitting in queues. only incremented under sleep_lock_, so sleepers can't miss one
+      std::atomic<size_t> queued_;
+      std::mutex sleep_lock_;
+      std::condition_variable sleep_cond_;
+      bool stop_;
+    };
+  }
+}
+
+#endif // WORK_STEALING_POOL_H_
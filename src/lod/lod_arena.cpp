@@ -0,0 +1,54 @@
+#include "lod/lod_arena.hpp"
+
+namespace terraingen {
+  namespace lod {
+    lod_arena::lod_arena(size_t block_size)
+      : block_size_(((block_size < 4 ? 4 : block_size) + 3) & ~static_cast<size_t>(3)),
+        block_(0),
+        used_(0),
+        node_count_(0) {}
+
+    lod_node* lod_arena::Alloc() {
+      return Take(1);
+    }
+
+    void lod_arena::AllocChildren(lod_node* parent) {
+      lod_node* children = Take(4);
+      parent->bl = children;
+      parent->br = children + 1;
+      parent->tl = children + 2;
+      parent->tr = children + 3;
+    }
+
+    void lod_arena::Reset() {
+      block_ = 0;
+      used_ = 0;
+      node_count_ = 0;
+    }
+
+    size_t lod_arena::GetNodeCount() const {
+      return node_count_;
+    }
+
+    lod_node* lod_arena::Take(size_t count) {
+      // siblings never straddle two blocks
+      if (used_ + count > block_size_) {
+        block_++;
+        used_ = 0;
+      }
+
+      if (block_ >= blocks_.size()) {
+        blocks_.emplace_back(new lod_node[block_size_]);
+      }
+
+      lod_node* nodes = blocks_[block_].get() + used_;
+      for (size_t i = 0; i < count; i++) {
+        nodes[i] = lod_node();
+      }
+
+      used_ += count;
+      node_count_ += count;
+      return nodes;
+    }
+  }
+}
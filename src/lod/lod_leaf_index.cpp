@@ -0,0 +1,73 @@
+#include "lod/lod_leaf_index.hpp"
+
+#include <algorithm>
+
+namespace terraingen {
+  namespace lod {
+    namespace {
+      // spreads the low 32 bits of a value out to every other bit
+      uint64_t SpreadBits(uint64_t value) {
+        value &= 0xFFFFFFFFull;
+        value = (value | (value << 16)) & 0x0000FFFF0000FFFFull;
+        value = (value | (value << 8))  & 0x00FF00FF00FF00FFull;
+        value = (value | (value << 4))  & 0x0F0F0F0F0F0F0F0Full;
+        value = (value | (value << 2))  & 0x3333333333333333ull;
+        value = (value | (value << 1))  & 0x5555555555555555ull;
+        return value;
+      }
+    }
+
+    uint64_t lod_leaf_index::Interleave(uint32_t x, uint32_t y) {
+      return SpreadBits(x) | (SpreadBits(y) << 1);
+    }
+
+    void lod_leaf_index::Build(const lod_node* tree, size_t tree_res) {
+      codes_.clear();
+      sizes_.clear();
+      tree_res_ = tree_res;
+
+      if (tree == nullptr) {
+        // matches GetChunkSize on an empty tree
+        codes_.push_back(0);
+        sizes_.push_back(tree_res * 2);
+        return;
+      }
+
+      Build_recurse(tree, 0, 0, tree_res);
+    }
+
+    void lod_leaf_index::Build_recurse(const lod_node* node, uint32_t x, uint32_t y, size_t size) {
+      if (node->bl == nullptr) {
+        codes_.push_back(Interleave(x, y));
+        sizes_.push_back(size);
+        return;
+      }
+
+      // bl, br, tl, tr is morton order - codes come out sorted
+      uint32_t half = static_cast<uint32_t>(size / 2);
+      Build_recurse(node->bl, x, y, size / 2);
+      Build_recurse(node->br, x + half, y, size / 2);
+      Build_recurse(node->tl, x, y + half, size / 2);
+      Build_recurse(node->tr, x + half, y + half, size / 2);
+    }
+
+    size_t lod_leaf_index::GetChunkSize(long cell_x, long cell_y) const {
+      const long last = static_cast<long>(tree_res_) - 1;
+      uint32_t x = static_cast<uint32_t>(std::min(std::max(cell_x, 0L), last));
+      uint32_t y = static_cast<uint32_t>(std::min(std::max(cell_y, 0L), last));
+      uint64_t code = Interleave(x, y);
+
+      // last leaf starting at or before our code. the first starts at 0, so there always is one.
+      // branch free - the compare turns into a conditional move
+      const uint64_t* base = codes_.data();
+      size_t count = codes_.size();
+      while (count > 1) {
+        size_t half = count / 2;
+        base = (base[half] <= code ? base + half : base);
+        count -= half;
+      }
+
+      return sizes_[base - codes_.data()];
+    }
+  }
+}
@@ -0,0 +1,38 @@
+#include "lod/lod_neighbours.hpp"
+
+namespace terraingen {
+  namespace lod {
+    void lod_neighbours::Build(const lod_node* tree, size_t tree_res, long leaf_x, long leaf_y, size_t leaf_size, size_t leaf_res) {
+      x = leaf_x;
+      y = leaf_y;
+      size = leaf_size;
+      chunk_res = leaf_res;
+      step = leaf_size / leaf_res;
+
+      const size_t count = leaf_res + 1;
+      sizes.resize(8 * count);
+
+      float left = static_cast<float>(leaf_x) - 0.5f;
+      float right = static_cast<float>(leaf_x + static_cast<long>(leaf_size)) + 0.5f;
+      float bottom = static_cast<float>(leaf_y) - 0.5f;
+      float top = static_cast<float>(leaf_y + static_cast<long>(leaf_size)) + 0.5f;
+
+      glm::vec2 step_x(static_cast<float>(step), 0.0f);
+      glm::vec2 step_y(0.0f, static_cast<float>(step));
+
+      // lo lines start from left and bottom, hi lines half a unit past the first vertex
+      float x_hi = static_cast<float>(leaf_x) + 0.5f;
+      float y_hi = static_cast<float>(leaf_y) + 0.5f;
+
+      size_t* output = sizes.data();
+      lod_node::GetChunkSizeLine(tree, tree_res, glm::vec2(left, bottom), step_y, count, output + (LEFT * 2) * count);
+      lod_node::GetChunkSizeLine(tree, tree_res, glm::vec2(left, y_hi), step_y, count, output + (LEFT * 2 + 1) * count);
+      lod_node::GetChunkSizeLine(tree, tree_res, glm::vec2(right, bottom), step_y, count, output + (RIGHT * 2) * count);
+      lod_node::GetChunkSizeLine(tree, tree_res, glm::vec2(right, y_hi), step_y, count, output + (RIGHT * 2 + 1) * count);
+      lod_node::GetChunkSizeLine(tree, tree_res, glm::vec2(left, bottom), step_x, count, output + (BOTTOM * 2) * count);
+      lod_node::GetChunkSizeLine(tree, tree_res, glm::vec2(x_hi, bottom), step_x, count, output + (BOTTOM * 2 + 1) * count);
+      lod_node::GetChunkSizeLine(tree, tree_res, glm::vec2(left, top), step_x, count, output + (TOP * 2) * count);
+      lod_node::GetChunkSizeLine(tree, tree_res, glm::vec2(x_hi, top), step_x, count, output + (TOP * 2 + 1) * count);
+    }
+  }
+}
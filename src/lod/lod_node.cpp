@@ -1,5 +1,7 @@
 #include "lod/lod_node.hpp"
 
+#include <algorithm>
+
 namespace terraingen {
   namespace lod {
     lod_node* lod_node::lod_node_alloc() {
@@ -18,22 +20,72 @@ namespace terraingen {
     size_t lod_node::GetChunkSize(const lod_node* node, size_t tree_res, const glm::vec2& sample_point) {
       glm::vec2 sub_sample_point = sample_point;
 
+      // walk down to the leaf holding our point
+      while (node != nullptr) {
+        // node covers [0, tree_res] - children split it in half
+        size_t half_res = tree_res / 2;
+        const lod_node* const* children = reinterpret_cast<const lod_node* const*>(node);
+        int child = 0;
+        if (sub_sample_point.y > half_res) {
+          child += 2;
+          sub_sample_point.y -= half_res;
+        }
+
+        if (sub_sample_point.x > half_res) {
+          child += 1;
+          sub_sample_point.x -= half_res;
+        }
+
+        node = children[child];
+        tree_res = half_res;
+      }
+
+      return tree_res * 2;
+    }
+
+    void lod_node::GetChunkSizeLine(const lod_node* node, size_t tree_res, const glm::vec2& origin, const glm::vec2& step, size_t count, size_t* output) {
+      if (count == 0) {
+        return;
+      }
+
       if (node == nullptr) {
-        return tree_res * 2;
+        std::fill(output, output + count, tree_res * 2);
+        return;
       }
 
-      const lod_node** node_ptr = reinterpret_cast<const lod_node**>(const_cast<lod_node*>(node));
-      if (sample_point.y > tree_res) {
-        node_ptr += 2;
-        sub_sample_point.y -= tree_res;
+      // axis the line runs along, and the one it's fixed on
+      int axis = (step.x != 0.0f ? 0 : 1);
+      int fixed_axis = 1 - axis;
+
+      size_t half_res = tree_res / 2;
+      float half = static_cast<float>(half_res);
+
+      // same as GetChunkSize - anything past the midpoint goes to the upper child
+      size_t low_count;
+      if (origin[axis] > half) {
+        low_count = 0;
+      } else if (step[axis] == 0.0f) {
+        low_count = count;
+      } else {
+        low_count = std::min(count, static_cast<size_t>((half - origin[axis]) / step[axis]) + 1);
       }
 
-      if (sample_point.x > tree_res) {
-        node_ptr += 1;
-        sub_sample_point.x -= tree_res;
+      const lod_node* const* children = reinterpret_cast<const lod_node* const*>(node);
+      // index of first child along our axis
+      int child_low = 0;
+      glm::vec2 sub_origin = origin;
+      if (origin[fixed_axis] > half) {
+        child_low += (fixed_axis == 1 ? 2 : 1);
+        sub_origin[fixed_axis] -= half;
       }
 
-      return GetChunkSize(*node_ptr, tree_res / 2, sub_sample_point);
+      int child_high = child_low + (axis == 1 ? 2 : 1);
+
+      GetChunkSizeLine(children[child_low], half_res, sub_origin, step, low_count, output);
+
+      sub_origin += step * static_cast<float>(low_count);
+      sub_origin[axis] -= half;
+      GetChunkSizeLine(children[child_high], half_res, sub_origin, step, count - low_count, output + low_count);
     }
   }
 }
\ No newline at end of file
@@ -0,0 +1,276 @@
+#include "terrain/VertexKernel.hpp"
+
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define TERRAINGEN_X86
+#include <immintrin.h>
+#endif
+
+namespace terraingen {
+  namespace terrain {
+    namespace {
+      // kernels write attributes as lanes, then scatter into the strided streams
+      template <int N>
+      struct LaneBuffer {
+        float pos_x[N];
+        float pos_y[N];
+        float norm_x[N];
+        float norm_y[N];
+        float norm_z[N];
+        float tan_x[N];
+        float tan_y[N];
+        float tan_z[N];
+        float tex_u[N];
+      };
+
+      template <typename T>
+      T* StreamAt(T* base, size_t stride, size_t index) {
+        return reinterpret_cast<T*>(reinterpret_cast<unsigned char*>(base) + stride * index);
+      }
+
+      template <int N>
+      void StoreLanes(const LaneBuffer<N>& lanes, float pos_z, float tex_v, const VertexStreams& output, size_t first) {
+        for (int i = 0; i < N; i++) {
+          if (output.position != nullptr) {
+            *StreamAt(output.position, output.stride, first + i) = glm::vec3(lanes.pos_x[i], lanes.pos_y[i], pos_z);
+          }
+
+          if (output.normal != nullptr) {
+            *StreamAt(output.normal, output.stride, first + i) = glm::vec3(lanes.norm_x[i], lanes.norm_y[i], lanes.norm_z[i]);
+          }
+
+          if (output.texcoord != nullptr) {
+            *StreamAt(output.texcoord, output.stride, first + i) = glm::vec2(lanes.tex_u[i], tex_v);
+          }
+
+          if (output.tangent != nullptr) {
+            *StreamAt(output.tangent, output.stride, first + i) = glm::vec4(lanes.tan_x[i], lanes.tan_y[i], lanes.tan_z[i], 1.0f);
+          }
+        }
+      }
+
+      // mirrors VertexGenerator::CreateVertex_internal op for op
+      void CreateVertexRow_scalar(const VertexRowInput& input, float scale, float scale_tex, const glm::vec3& offset, const VertexStreams& output, size_t first) {
+        for (size_t i = first; i < input.count; i++) {
+          long x = input.offset_x + static_cast<long>(i) * input.step;
+          long y = input.offset_y;
+
+          glm::vec3 position = glm::vec3(x * scale, input.heights[i], y * scale) - offset;
+          if (output.position != nullptr) {
+            *StreamAt(output.position, output.stride, i) = position;
+          }
+
+          if (output.texcoord != nullptr) {
+            *StreamAt(output.texcoord, output.stride, i) = glm::vec2(x * scale_tex, y * scale_tex);
+          }
+
+          if (output.normal == nullptr && output.tangent == nullptr) {
+            continue;
+          }
+
+          glm::vec3 coord_l = glm::vec3((x - input.step) * scale, input.heights[i - 1], y * scale) - offset;
+          glm::vec3 coord_r = glm::vec3((x + input.step) * scale, input.heights[i + 1], y * scale) - offset;
+          glm::vec3 coord_d = glm::vec3(x * scale, input.heights_down[i], (y - input.step) * scale) - offset;
+          glm::vec3 coord_u = glm::vec3(x * scale, input.heights_up[i], (y + input.step) * scale) - offset;
+
+          glm::vec3 tangent = glm::normalize(coord_r - coord_l);
+          glm::vec3 bitangent = glm::normalize(coord_u - coord_d);
+          glm::vec3 normal = glm::cross(bitangent, tangent);
+
+          if (output.normal != nullptr) {
+            *StreamAt(output.normal, output.stride, i) = normal;
+          }
+
+          if (output.tangent != nullptr) {
+            *StreamAt(output.tangent, output.stride, i) = glm::vec4(tangent, 1.0);
+          }
+        }
+      }
+
+#ifdef TERRAINGEN_X86
+      // returns the number of vertices written
+      size_t CreateVertexRow_sse(const VertexRowInput& input, float scale, float scale_tex, const glm::vec3& offset, const VertexStreams& output) {
+        const int step = static_cast<int>(input.step);
+        const long y = input.offset_y;
+
+        // row-constant terms, computed exactly as the scalar path would
+        const float pos_z = y * scale - offset.z;
+        const float pos_z_d = (y - input.step) * scale - offset.z;
+        const float pos_z_u = (y + input.step) * scale - offset.z;
+        const float tex_v = y * scale_tex;
+
+        const __m128 v_scale = _mm_set1_ps(scale);
+        const __m128 v_scale_tex = _mm_set1_ps(scale_tex);
+        const __m128 v_off_x = _mm_set1_ps(offset.x);
+        const __m128 v_off_y = _mm_set1_ps(offset.y);
+        const __m128 v_one = _mm_set1_ps(1.0f);
+        const __m128 v_tan_z = _mm_set1_ps(pos_z - pos_z);
+        const __m128 v_bit_z = _mm_set1_ps(pos_z_u - pos_z_d);
+        const __m128i v_lane_step = _mm_set_epi32(3 * step, 2 * step, step, 0);
+        const __m128i v_step = _mm_set1_epi32(step);
+
+        // positions and texcoords alone skip the tangent frame
+        const bool frame = (output.normal != nullptr || output.tangent != nullptr);
+
+        LaneBuffer<4> lanes;
+        size_t i = 0;
+        for (; i + 4 <= input.count; i += 4) {
+          __m128i x = _mm_add_epi32(_mm_set1_epi32(static_cast<int>(input.offset_x + static_cast<long>(i) * input.step)), v_lane_step);
+          __m128 x_c = _mm_cvtepi32_ps(x);
+          __m128 x_l = _mm_cvtepi32_ps(_mm_sub_epi32(x, v_step));
+          __m128 x_r = _mm_cvtepi32_ps(_mm_add_epi32(x, v_step));
+
+          __m128 pos_x = _mm_sub_ps(_mm_mul_ps(x_c, v_scale), v_off_x);
+          __m128 pos_y = _mm_sub_ps(_mm_loadu_ps(input.heights + i), v_off_y);
+
+          _mm_storeu_ps(lanes.pos_x, pos_x);
+          _mm_storeu_ps(lanes.pos_y, pos_y);
+          _mm_storeu_ps(lanes.tex_u, _mm_mul_ps(x_c, v_scale_tex));
+
+          if (frame) {
+            // tangent: r - l
+            __m128 tan_x = _mm_sub_ps(_mm_sub_ps(_mm_mul_ps(x_r, v_scale), v_off_x), _mm_sub_ps(_mm_mul_ps(x_l, v_scale), v_off_x));
+            __m128 tan_y = _mm_sub_ps(_mm_sub_ps(_mm_loadu_ps(input.heights + i + 1), v_off_y), _mm_sub_ps(_mm_loadu_ps(input.heights + i - 1), v_off_y));
+            __m128 tan_z = v_tan_z;
+
+            // bitangent: u - d
+            __m128 bit_x = _mm_sub_ps(pos_x, pos_x);
+            __m128 bit_y = _mm_sub_ps(_mm_sub_ps(_mm_loadu_ps(input.heights_up + i), v_off_y), _mm_sub_ps(_mm_loadu_ps(input.heights_down + i), v_off_y));
+            __m128 bit_z = v_bit_z;
+
+            __m128 dot = _mm_add_ps(_mm_add_ps(_mm_mul_ps(tan_x, tan_x), _mm_mul_ps(tan_y, tan_y)), _mm_mul_ps(tan_z, tan_z));
+            __m128 inv = _mm_div_ps(v_one, _mm_sqrt_ps(dot));
+            tan_x = _mm_mul_ps(tan_x, inv);
+            tan_y = _mm_mul_ps(tan_y, inv);
+            tan_z = _mm_mul_ps(tan_z, inv);
+
+            dot = _mm_add_ps(_mm_add_ps(_mm_mul_ps(bit_x, bit_x), _mm_mul_ps(bit_y, bit_y)), _mm_mul_ps(bit_z, bit_z));
+            inv = _mm_div_ps(v_one, _mm_sqrt_ps(dot));
+            bit_x = _mm_mul_ps(bit_x, inv);
+            bit_y = _mm_mul_ps(bit_y, inv);
+            bit_z = _mm_mul_ps(bit_z, inv);
+
+            // normal: cross(bitangent, tangent)
+            _mm_storeu_ps(lanes.norm_x, _mm_sub_ps(_mm_mul_ps(bit_y, tan_z), _mm_mul_ps(tan_y, bit_z)));
+            _mm_storeu_ps(lanes.norm_y, _mm_sub_ps(_mm_mul_ps(bit_z, tan_x), _mm_mul_ps(tan_z, bit_x)));
+            _mm_storeu_ps(lanes.norm_z, _mm_sub_ps(_mm_mul_ps(bit_x, tan_y), _mm_mul_ps(tan_x, bit_y)));
+
+            _mm_storeu_ps(lanes.tan_x, tan_x);
+            _mm_storeu_ps(lanes.tan_y, tan_y);
+            _mm_storeu_ps(lanes.tan_z, tan_z);
+          }
+
+          StoreLanes(lanes, pos_z, tex_v, output, i);
+        }
+
+        return i;
+      }
+
+      __attribute__((target("avx2")))
+      size_t CreateVertexRow_avx2(const VertexRowInput& input, float scale, float scale_tex, const glm::vec3& offset, const VertexStreams& output) {
+        const int step = static_cast<int>(input.step);
+        const long y = input.offset_y;
+
+        const float pos_z = y * scale - offset.z;
+        const float pos_z_d = (y - input.step) * scale - offset.z;
+        const float pos_z_u = (y + input.step) * scale - offset.z;
+        const float tex_v = y * scale_tex;
+
+        const __m256 v_scale = _mm256_set1_ps(scale);
+        const __m256 v_scale_tex = _mm256_set1_ps(scale_tex);
+        const __m256 v_off_x = _mm256_set1_ps(offset.x);
+        const __m256 v_off_y = _mm256_set1_ps(offset.y);
+        const __m256 v_one = _mm256_set1_ps(1.0f);
+        const __m256 v_tan_z = _mm256_set1_ps(pos_z - pos_z);
+        const __m256 v_bit_z = _mm256_set1_ps(pos_z_u - pos_z_d);
+        const __m256i v_lane_step = _mm256_set_epi32(7 * step, 6 * step, 5 * step, 4 * step, 3 * step, 2 * step, step, 0);
+        const __m256i v_step = _mm256_set1_epi32(step);
+
+        // positions and texcoords alone skip the tangent frame
+        const bool frame = (output.normal != nullptr || output.tangent != nullptr);
+
+        LaneBuffer<8> lanes;
+        size_t i = 0;
+        for (; i + 8 <= input.count; i += 8) {
+          __m256i x = _mm256_add_epi32(_mm256_set1_epi32(static_cast<int>(input.offset_x + static_cast<long>(i) * input.step)), v_lane_step);
+          __m256 x_c = _mm256_cvtepi32_ps(x);
+          __m256 x_l = _mm256_cvtepi32_ps(_mm256_sub_epi32(x, v_step));
+          __m256 x_r = _mm256_cvtepi32_ps(_mm256_add_epi32(x, v_step));
+
+          __m256 pos_x = _mm256_sub_ps(_mm256_mul_ps(x_c, v_scale), v_off_x);
+          __m256 pos_y = _mm256_sub_ps(_mm256_loadu_ps(input.heights + i), v_off_y);
+
+          _mm256_storeu_ps(lanes.pos_x, pos_x);
+          _mm256_storeu_ps(lanes.pos_y, pos_y);
+          _mm256_storeu_ps(lanes.tex_u, _mm256_mul_ps(x_c, v_scale_tex));
+
+          if (frame) {
+            __m256 tan_x = _mm256_sub_ps(_mm256_sub_ps(_mm256_mul_ps(x_r, v_scale), v_off_x), _mm256_sub_ps(_mm256_mul_ps(x_l, v_scale), v_off_x));
+            __m256 tan_y = _mm256_sub_ps(_mm256_sub_ps(_mm256_loadu_ps(input.heights + i + 1), v_off_y), _mm256_sub_ps(_mm256_loadu_ps(input.heights + i - 1), v_off_y));
+            __m256 tan_z = v_tan_z;
+
+            __m256 bit_x = _mm256_sub_ps(pos_x, pos_x);
+            __m256 bit_y = _mm256_sub_ps(_mm256_sub_ps(_mm256_loadu_ps(input.heights_up + i), v_off_y), _mm256_sub_ps(_mm256_loadu_ps(input.heights_down + i), v_off_y));
+            __m256 bit_z = v_bit_z;
+
+            // no fma here - keep rounding identical to the scalar path
+            __m256 dot = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(tan_x, tan_x), _mm256_mul_ps(tan_y, tan_y)), _mm256_mul_ps(tan_z, tan_z));
+            __m256 inv = _mm256_div_ps(v_one, _mm256_sqrt_ps(dot));
+            tan_x = _mm256_mul_ps(tan_x, inv);
+            tan_y = _mm256_mul_ps(tan_y, inv);
+            tan_z = _mm256_mul_ps(tan_z, inv);
+
+            dot = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(bit_x, bit_x), _mm256_mul_ps(bit_y, bit_y)), _mm256_mul_ps(bit_z, bit_z));
+            inv = _mm256_div_ps(v_one, _mm256_sqrt_ps(dot));
+            bit_x = _mm256_mul_ps(bit_x, inv);
+            bit_y = _mm256_mul_ps(bit_y, inv);
+            bit_z = _mm256_mul_ps(bit_z, inv);
+
+            _mm256_storeu_ps(lanes.norm_x, _mm256_sub_ps(_mm256_mul_ps(bit_y, tan_z), _mm256_mul_ps(tan_y, bit_z)));
+            _mm256_storeu_ps(lanes.norm_y, _mm256_sub_ps(_mm256_mul_ps(bit_z, tan_x), _mm256_mul_ps(tan_z, bit_x)));
+            _mm256_storeu_ps(lanes.norm_z, _mm256_sub_ps(_mm256_mul_ps(bit_x, tan_y), _mm256_mul_ps(tan_x, bit_y)));
+
+            _mm256_storeu_ps(lanes.tan_x, tan_x);
+            _mm256_storeu_ps(lanes.tan_y, tan_y);
+            _mm256_storeu_ps(lanes.tan_z, tan_z);
+          }
+
+          StoreLanes(lanes, pos_z, tex_v, output, i);
+        }
+
+        return i;
+      }
+#endif
+    }
+
+    SimdLevel GetSimdLevel() {
+#ifdef TERRAINGEN_X86
+      static const SimdLevel level = (__builtin_cpu_supports("avx2") ? AVX2 : SSE);
+      return level;
+#else
+      return SCALAR;
+#endif
+    }
+
+    void CreateVertexRow(const VertexRowInput& input, float scale, float scale_tex, const glm::vec3& offset, const VertexStreams& output, SimdLevel level) {
+      level = std::min(level, GetSimdLevel());
+      size_t first = 0;
+
+#ifdef TERRAINGEN_X86
+      if (level == AVX2) {
+        first = CreateVertexRow_avx2(input, scale, scale_tex, offset, output);
+      } else if (level == SSE) {
+        first = CreateVertexRow_sse(input, scale, scale_tex, offset, output);
+      }
+#endif
+
+      // leftovers
+      CreateVertexRow_scalar(input, scale, scale_tex, offset, output, first);
+    }
+
+    void CreateVertexRow(const VertexRowInput& input, float scale, float scale_tex, const glm::vec3& offset, const VertexStreams& output) {
+      CreateVertexRow(input, scale, scale_tex, offset, output, GetSimdLevel());
+    }
+  }
+}
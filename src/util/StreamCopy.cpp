@@ -0,0 +1,92 @@
+#include "util/StreamCopy.hpp"
+
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define TERRAINGEN_X86
+#include <immintrin.h>
+#endif
+
+namespace terraingen {
+  namespace util {
+    namespace {
+#ifdef TERRAINGEN_X86
+      // bytes until dst sits on a 16 byte boundary
+      size_t GetHeadBytes(const void* dst, size_t bytes) {
+        size_t misalign = reinterpret_cast<uintptr_t>(dst) & 15;
+        size_t head = (misalign == 0 ? 0 : 16 - misalign);
+        return (head < bytes ? head : bytes);
+      }
+#endif
+    }
+
+    void StreamCopy(void* dst, const void* src, size_t bytes) {
+#ifdef TERRAINGEN_X86
+      unsigned char* out = reinterpret_cast<unsigned char*>(dst);
+      const unsigned char* in = reinterpret_cast<const unsigned char*>(src);
+
+      // streaming stores want an aligned destination - the source can be anywhere
+      size_t head = GetHeadBytes(out, bytes);
+      memcpy(out, in, head);
+      out += head;
+      in += head;
+      bytes -= head;
+
+      size_t i = 0;
+      for (; i + 64 <= bytes; i += 64) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i + 16));
+        __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i + 32));
+        __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i + 48));
+        _mm_stream_si128(reinterpret_cast<__m128i*>(out + i), a);
+        _mm_stream_si128(reinterpret_cast<__m128i*>(out + i + 16), b);
+        _mm_stream_si128(reinterpret_cast<__m128i*>(out + i + 32), c);
+        _mm_stream_si128(reinterpret_cast<__m128i*>(out + i + 48), d);
+      }
+
+      for (; i + 16 <= bytes; i += 16) {
+        _mm_stream_si128(reinterpret_cast<__m128i*>(out + i), _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i)));
+      }
+
+      memcpy(out + i, in + i, bytes - i);
+
+      // streamed stores aren't ordered with anything else - make them visible before whoever reads this next
+      _mm_sfence();
+#else
+      memcpy(dst, src, bytes);
+#endif
+    }
+
+    void CopyIndices(unsigned int* dst, const unsigned int* src, size_t count, unsigned int offset, bool streaming) {
+      size_t i = 0;
+#ifdef TERRAINGEN_X86
+      if (streaming) {
+        // indices are 4 byte aligned, so the head is whole indices
+        size_t head = GetHeadBytes(dst, count * sizeof(unsigned int)) / sizeof(unsigned int);
+        for (; i < head; i++) {
+          dst[i] = src[i] + offset;
+        }
+
+        const __m128i add = _mm_set1_epi32(static_cast<int>(offset));
+        for (; i + 4 <= count; i += 4) {
+          __m128i value = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+          _mm_stream_si128(reinterpret_cast<__m128i*>(dst + i), _mm_add_epi32(value, add));
+        }
+
+        for (; i < count; i++) {
+          dst[i] = src[i] + offset;
+        }
+
+        _mm_sfence();
+        return;
+      }
+#endif
+
+      // plain loop vectorizes fine
+      for (; i < count; i++) {
+        dst[i] = src[i] + offset;
+      }
+    }
+  }
+}
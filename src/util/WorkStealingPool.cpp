@@ -0,0 +1,104 @@
+#include "util/WorkStealingPool.hpp"
+
+namespace terraingen {
+  namespace util {
+    namespace {
+      // pool and queue index of the worker running on this thread, if any
+      thread_local const WorkStealingPool* current_pool = nullptr;
+      thread_local size_t current_index = 0;
+    }
+
+    WorkStealingPool::WorkStealingPool(size_t threads) : next_queue_(0), queued_(0), stop_(false) {
+      for (size_t i = 0; i < threads; i++) {
+        queues_.emplace_back(new Queue());
+      }
+
+      for (size_t i = 0; i < threads; i++) {
+        threads_.emplace_back(&WorkStealingPool::WorkerLoop, this, i);
+      }
+    }
+
+    WorkStealingPool::~WorkStealingPool() {
+      {
+        std::lock_guard<std::mutex> lock(sleep_lock_);
+        stop_ = true;
+      }
+
+      sleep_cond_.notify_all();
+      for (auto& thread : threads_) {
+        thread.join();
+      }
+    }
+
+    void WorkStealingPool::Submit(std::function<void()> task) {
+      if (queues_.empty()) {
+        task();
+        return;
+      }
+
+      // count it first, so a worker can't take it and push the count below zero
+      {
+        std::lock_guard<std::mutex> lock(sleep_lock_);
+        queued_++;
+      }
+
+      size_t index = (current_pool == this ? current_index : next_queue_++ % queues_.size());
+      {
+        std::lock_guard<std::mutex> lock(queues_[index]->lock);
+        queues_[index]->tasks.push_back(std::move(task));
+      }
+
+      sleep_cond_.notify_one();
+    }
+
+    size_t WorkStealingPool::GetConcurrency() const {
+      return threads_.size() + 1;
+    }
+
+    void WorkStealingPool::WorkerLoop(size_t index) {
+      current_pool = this;
+      current_index = index;
+
+      std::function<void()> task;
+      while (true) {
+        if (TakeTask(index, &task)) {
+          task();
+          task = nullptr;
+          continue;
+        }
+
+        std::unique_lock<std::mutex> lock(sleep_lock_);
+        sleep_cond_.wait(lock, [this] { return stop_ || queued_ > 0; });
+        if (stop_ && queued_ == 0) {
+          return;
+        }
+      }
+    }
+
+    bool WorkStealingPool::TakeTask(size_t index, std::function<void()>* task) {
+      {
+        Queue& own = *queues_[index];
+        std::lock_guard<std::mutex> lock(own.lock);
+        if (!own.tasks.empty()) {
+          *task = std::move(own.tasks.back());
+          own.tasks.pop_back();
+          queued_--;
+          return true;
+        }
+      }
+
+      for (size_t i = 1; i < queues_.size(); i++) {
+        Queue& victim = *queues_[(index + i) % queues_.size()];
+        std::lock_guard<std::mutex> lock(victim.lock);
+        if (!victim.tasks.empty()) {
+          *task = std::move(victim.tasks.front());
+          victim.tasks.pop_front();
+          queued_--;
+          return true;
+        }
+      }
+
+      return false;
+    }
+  }
+}
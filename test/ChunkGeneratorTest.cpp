@@ -130,4 +130,728 @@ TEST(ChunkGeneratorTest, MultipleLod) {
   delete[] normals;
   delete[] tangents;
   delete[] texcoords;
-}
\ No newline at end of file
+}
+
+struct CountingSampler {
+  size_t samples = 0;
+  float Get(int x, int y) {
+    samples++;
+    return static_cast<float>(sin(0.125 * x) + cos(0.25 * y));
+  }
+};
+
+TEST(ChunkGeneratorTest, HeightGridMatchesPerVertexSampling) {
+  std::shared_ptr<CountingSampler> sampler = std::make_shared<CountingSampler>();
+  VertexGenerator<CountingSampler> gen(sampler, 1.0f, (1.0 / 128.0), 32, 128, glm::vec3(0));
+
+  lod::lod_node* node = lod_node::lod_node_alloc();
+  node->tl = lod_node::lod_node_alloc();
+  node->tr = lod_node::lod_node_alloc();
+  node->bl = lod_node::lod_node_alloc();
+  node->br = lod_node::lod_node_alloc();
+
+  lod_neighbours neighbours;
+  neighbours.Build(node, 128, 64, 0, 64, 32);
+  auto chunk = Chunk::chunk_create(gen, 64, 0, 0, 2, 32, neighbours);
+
+  // one sample per grid point, plus a handful for the outer edge of the border
+  EXPECT_LT(sampler->samples, 35 * 35 + 8 * 33);
+
+  for (int y = 0; y <= 32; y++) {
+    for (int x = 0; x <= 32; x++) {
+      Vertex expected = gen.CreateVertex(64 + x * 2, y * 2, 2, node);
+      Vertex& actual = chunk->vertex_data[x * 33 + y];
+      EXPECT_EQ(actual.position, expected.position);
+      EXPECT_EQ(actual.normal, expected.normal);
+      EXPECT_EQ(actual.texcoord, expected.texcoord);
+      EXPECT_EQ(actual.tangent, expected.tangent);
+    }
+  }
+
+  lod_node::lod_node_free(node);
+}
+
+struct RegionSampler {
+  size_t samples = 0;
+  size_t region_calls = 0;
+  float Get(int x, int y) {
+    samples++;
+    return static_cast<float>(sin(0.125 * x) + cos(0.25 * y));
+  }
+
+  void GetRegion(int x, int y, int step, int count_x, int count_y, float* output, size_t stride) {
+    region_calls++;
+    for (int j = 0; j < count_y; j++) {
+      for (int i = 0; i < count_x; i++) {
+        output[j * stride + i] = static_cast<float>(sin(0.125 * (x + i * step)) + cos(0.25 * (y + j * step)));
+      }
+    }
+  }
+};
+
+TEST(ChunkGeneratorTest, RegionSamplingMatchesScalarSampling) {
+  static_assert(traits::height_map_region<RegionSampler>::value);
+  static_assert(!traits::height_map_region<CountingSampler>::value);
+
+  std::shared_ptr<RegionSampler> region_sampler = std::make_shared<RegionSampler>();
+  std::shared_ptr<CountingSampler> scalar_sampler = std::make_shared<CountingSampler>();
+  VertexGenerator<RegionSampler> region_gen(region_sampler, 1.0f, (1.0 / 128.0), 32, 128, glm::vec3(0));
+  VertexGenerator<CountingSampler> scalar_gen(scalar_sampler, 1.0f, (1.0 / 128.0), 32, 128, glm::vec3(0));
+
+  lod::lod_node* node = lod_node::lod_node_alloc();
+  node->tl = lod_node::lod_node_alloc();
+  node->tr = lod_node::lod_node_alloc();
+  node->bl = lod_node::lod_node_alloc();
+  node->br = lod_node::lod_node_alloc();
+
+  lod_neighbours neighbours;
+  neighbours.Build(node, 128, 0, 64, 64, 32);
+  auto region_chunk = Chunk::chunk_create(region_gen, 0, 64, 0, 2, 32, neighbours);
+  auto scalar_chunk = Chunk::chunk_create(scalar_gen, 0, 64, 0, 2, 32, neighbours);
+
+  EXPECT_EQ(region_sampler->region_calls, 1);
+  // only samples outside of the padded grid go through Get
+  EXPECT_LT(region_sampler->samples, scalar_sampler->samples - 33 * 33);
+
+  for (int i = 0; i < 33 * 33; i++) {
+    EXPECT_EQ(region_chunk->vertex_data[i].position, scalar_chunk->vertex_data[i].position);
+    EXPECT_EQ(region_chunk->vertex_data[i].normal, scalar_chunk->vertex_data[i].normal);
+  }
+
+  lod_node::lod_node_free(node);
+}
+
+TEST(ChunkGeneratorTest, DownsampledChunkMatchesSampledChunk) {
+  std::shared_ptr<CountingSampler> sampler = std::make_shared<CountingSampler>();
+  ChunkGenerator<CountingSampler> generator(sampler, 1.0, (1.0 / 128.0), glm::vec3(0), 32);
+
+  lod::lod_node* fine = lod_node::lod_node_alloc();
+  fine->tl = lod_node::lod_node_alloc();
+  fine->tr = lod_node::lod_node_alloc();
+  fine->bl = lod_node::lod_node_alloc();
+  fine->br = lod_node::lod_node_alloc();
+  fine->br->tl = lod_node::lod_node_alloc();
+  fine->br->tr = lod_node::lod_node_alloc();
+  fine->br->bl = lod_node::lod_node_alloc();
+  fine->br->br = lod_node::lod_node_alloc();
+
+  lod::lod_node* coarse = lod_node::lod_node_alloc();
+  coarse->tl = lod_node::lod_node_alloc();
+  coarse->tr = lod_node::lod_node_alloc();
+  coarse->bl = lod_node::lod_node_alloc();
+  coarse->br = lod_node::lod_node_alloc();
+
+  generator.UpdateChunks(fine, 128);
+  sampler->samples = 0;
+
+  // br is the only new chunk, and all four of its children are cached
+  generator.UpdateChunks(coarse, 128);
+  ASSERT_EQ(generator.GetChunkCount(), 4);
+  EXPECT_LT(sampler->samples, 35 * 35 / 2);
+
+  std::shared_ptr<CountingSampler> fresh_sampler = std::make_shared<CountingSampler>();
+  ChunkGenerator<CountingSampler> fresh_generator(fresh_sampler, 1.0, (1.0 / 128.0), glm::vec3(0), 32);
+  fresh_generator.UpdateChunks(coarse, 128);
+
+  std::vector<Vertex> downsampled(33 * 33 * 4);
+  std::vector<Vertex> sampled(33 * 33 * 4);
+  generator.WriteVertexBuffer(downsampled.data(), downsampled.size() * sizeof(Vertex));
+  fresh_generator.WriteVertexBuffer(sampled.data(), sampled.size() * sizeof(Vertex));
+
+  // chunks are written most recent first - br is third.
+  // the others were cached against a finer br, so their edges differ.
+  for (int i = 33 * 33 * 2; i < 33 * 33 * 3; i++) {
+    EXPECT_EQ(downsampled[i].position, sampled[i].position);
+    EXPECT_EQ(downsampled[i].normal, sampled[i].normal);
+    EXPECT_EQ(downsampled[i].texcoord, sampled[i].texcoord);
+    EXPECT_EQ(downsampled[i].tangent, sampled[i].tangent);
+  }
+
+  lod_node::lod_node_free(fine);
+  lod_node::lod_node_free(coarse);
+}
+
+TEST(ChunkGeneratorTest, AttributeMaskStoresOnlyRequestedAttributes) {
+  static_assert(sizeof(VertexFormat<POSITION>) == sizeof(glm::vec3));
+  static_assert(sizeof(VertexFormat<POSITION | TEXCOORD>) == sizeof(glm::vec3) + sizeof(glm::vec2));
+
+  std::shared_ptr<CountingSampler> full_sampler = std::make_shared<CountingSampler>();
+  std::shared_ptr<CountingSampler> position_sampler = std::make_shared<CountingSampler>();
+  ChunkGenerator<CountingSampler> full_generator(full_sampler, 1.0, (1.0 / 128.0), glm::vec3(0), 32);
+  ChunkGenerator<CountingSampler, POSITION | TEXCOORD> position_generator(position_sampler, 1.0, (1.0 / 128.0), glm::vec3(0), 32);
+
+  lod::lod_node* node = lod_node::lod_node_alloc();
+  node->tl = lod_node::lod_node_alloc();
+  node->tr = lod_node::lod_node_alloc();
+  node->bl = lod_node::lod_node_alloc();
+  node->br = lod_node::lod_node_alloc();
+  node->br->tl = lod_node::lod_node_alloc();
+  node->br->tr = lod_node::lod_node_alloc();
+  node->br->bl = lod_node::lod_node_alloc();
+  node->br->br = lod_node::lod_node_alloc();
+
+  full_generator.UpdateChunks(node, 128);
+  position_generator.UpdateChunks(node, 128);
+
+  ASSERT_EQ(position_generator.GetVertexBufferSize(), 33 * 33 * 7 * (sizeof(glm::vec3) + sizeof(glm::vec2)));
+
+  // no normals along the borders means no neighbors to sample
+  EXPECT_LT(position_sampler->samples, full_sampler->samples);
+
+  std::vector<Vertex> full(33 * 33 * 7);
+  std::vector<VertexFormat<POSITION | TEXCOORD>> packed(33 * 33 * 7);
+  full_generator.WriteVertexBuffer(full.data(), full.size() * sizeof(Vertex));
+  ASSERT_EQ(position_generator.WriteVertexBuffer(packed.data(), packed.size() * sizeof(packed[0])), packed.size() * sizeof(packed[0]));
+
+  for (int i = 0; i < 33 * 33 * 7; i++) {
+    EXPECT_EQ(packed[i].position, full[i].position);
+    EXPECT_EQ(packed[i].texcoord, full[i].texcoord);
+  }
+
+  std::vector<glm::vec3> positions(33 * 33 * 7);
+  std::vector<glm::vec2> texcoords(33 * 33 * 7);
+  ASSERT_EQ(position_generator.WriteVertexBufferSeparate(positions.data(), nullptr, texcoords.data(), nullptr, 33 * 33 * 7), 33 * 33 * 7);
+  for (int i = 0; i < 33 * 33 * 7; i++) {
+    EXPECT_EQ(positions[i], full[i].position);
+    EXPECT_EQ(texcoords[i], full[i].texcoord);
+  }
+
+  lod_node::lod_node_free(node);
+}
+
+TEST(ChunkGeneratorTest, AttributeMaskWithoutPositions) {
+  std::shared_ptr<CountingSampler> full_sampler = std::make_shared<CountingSampler>();
+  std::shared_ptr<CountingSampler> surface_sampler = std::make_shared<CountingSampler>();
+  ChunkGenerator<CountingSampler> full_generator(full_sampler, 1.0, (1.0 / 128.0), glm::vec3(0), 32);
+  ChunkGenerator<CountingSampler, NORMAL | TEXCOORD> surface_generator(surface_sampler, 1.0, (1.0 / 128.0), glm::vec3(0), 32);
+
+  lod::lod_node* fine = lod_node::lod_node_alloc();
+  fine->tl = lod_node::lod_node_alloc();
+  fine->tr = lod_node::lod_node_alloc();
+  fine->bl = lod_node::lod_node_alloc();
+  fine->br = lod_node::lod_node_alloc();
+  fine->br->tl = lod_node::lod_node_alloc();
+  fine->br->tr = lod_node::lod_node_alloc();
+  fine->br->bl = lod_node::lod_node_alloc();
+  fine->br->br = lod_node::lod_node_alloc();
+
+  lod::lod_node* coarse = lod_node::lod_node_alloc();
+  coarse->tl = lod_node::lod_node_alloc();
+  coarse->tr = lod_node::lod_node_alloc();
+  coarse->bl = lod_node::lod_node_alloc();
+  coarse->br = lod_node::lod_node_alloc();
+
+  // br's children are cached, but there are no heights to build it from - it gets sampled
+  surface_generator.UpdateChunks(fine, 128);
+  surface_generator.UpdateChunks(coarse, 128);
+  full_generator.UpdateChunks(coarse, 128);
+  ASSERT_EQ(surface_generator.GetChunkCount(), 4);
+
+  std::vector<Vertex> full(33 * 33 * 4);
+  std::vector<VertexFormat<NORMAL | TEXCOORD>> packed(33 * 33 * 4);
+  full_generator.WriteVertexBuffer(full.data(), full.size() * sizeof(Vertex));
+  ASSERT_EQ(surface_generator.WriteVertexBuffer(packed.data(), packed.size() * sizeof(packed[0])), packed.size() * sizeof(packed[0]));
+
+  // br is third, most recent first
+  for (int i = 33 * 33 * 2; i < 33 * 33 * 3; i++) {
+    EXPECT_EQ(packed[i].normal, full[i].normal);
+    EXPECT_EQ(packed[i].texcoord, full[i].texcoord);
+  }
+
+  lod_node::lod_node_free(fine);
+  lod_node::lod_node_free(coarse);
+}
+
+TEST(ChunkGeneratorTest, StaticResolutionMatchesDynamic) {
+  std::shared_ptr<CountingSampler> sampler = std::make_shared<CountingSampler>();
+  ChunkGenerator<CountingSampler> dynamic_generator(sampler, 1.0, (1.0 / 128.0), glm::vec3(0), 32);
+  ChunkGenerator<CountingSampler, ALL_ATTRIBUTES, 32> static_generator(sampler, 1.0, (1.0 / 128.0), glm::vec3(0), 32);
+
+  lod::lod_node* node = lod_node::lod_node_alloc();
+  node->tl = lod_node::lod_node_alloc();
+  node->tr = lod_node::lod_node_alloc();
+  node->bl = lod_node::lod_node_alloc();
+  node->br = lod_node::lod_node_alloc();
+  node->br->tl = lod_node::lod_node_alloc();
+  node->br->tr = lod_node::lod_node_alloc();
+  node->br->bl = lod_node::lod_node_alloc();
+  node->br->br = lod_node::lod_node_alloc();
+
+  dynamic_generator.UpdateChunks(node, 128);
+  static_generator.UpdateChunks(node, 128);
+
+  ASSERT_EQ(static_generator.GetVertexBufferSize(), dynamic_generator.GetVertexBufferSize());
+  ASSERT_EQ(static_generator.GetIndexBufferSize(), dynamic_generator.GetIndexBufferSize());
+
+  std::vector<Vertex> dynamic_vertices(33 * 33 * 7);
+  std::vector<Vertex> static_vertices(33 * 33 * 7);
+  dynamic_generator.WriteVertexBuffer(dynamic_vertices.data(), dynamic_vertices.size() * sizeof(Vertex));
+  static_generator.WriteVertexBuffer(static_vertices.data(), static_vertices.size() * sizeof(Vertex));
+
+  for (int i = 0; i < 33 * 33 * 7; i++) {
+    EXPECT_EQ(static_vertices[i].position, dynamic_vertices[i].position);
+    EXPECT_EQ(static_vertices[i].normal, dynamic_vertices[i].normal);
+    EXPECT_EQ(static_vertices[i].texcoord, dynamic_vertices[i].texcoord);
+    EXPECT_EQ(static_vertices[i].tangent, dynamic_vertices[i].tangent);
+  }
+
+  std::vector<unsigned int> dynamic_indices(32 * 32 * 6 * 7);
+  std::vector<unsigned int> static_indices(32 * 32 * 6 * 7);
+  dynamic_generator.WriteIndexBuffer(dynamic_indices.data(), dynamic_indices.size() * sizeof(unsigned int));
+  static_generator.WriteIndexBuffer(static_indices.data(), static_indices.size() * sizeof(unsigned int));
+  EXPECT_EQ(static_indices, dynamic_indices);
+
+  // a runtime resolution that disagrees is refused outright, not quietly ignored
+  EXPECT_THROW((ChunkGenerator<CountingSampler, ALL_ATTRIBUTES, 32>(sampler, 1.0, (1.0 / 128.0), glm::vec3(0), 16)), std::invalid_argument);
+
+  lod_node::lod_node_free(node);
+}
+
+struct SmoothSampler {
+  size_t samples = 0;
+  float Get(int x, int y) {
+    samples++;
+    return static_cast<float>(8.0 * sin(x / 512.0) + 4.0 * cos(y / 256.0));
+  }
+};
+
+TEST(ChunkGeneratorTest, ApproximateSamplingStaysWithinBound) {
+  std::shared_ptr<SmoothSampler> sampler = std::make_shared<SmoothSampler>();
+  VertexGenerator<SmoothSampler> exact_gen(sampler, 1.0f, (1.0 / 128.0), 32, 1024, glm::vec3(0));
+  VertexGenerator<SmoothSampler> approx_gen(sampler, 1.0f, (1.0 / 128.0), 32, 1024, glm::vec3(0));
+  approx_gen.SetApproximateSampling({ 256, 4, 0.05f });
+  ASSERT_TRUE(approx_gen.ShouldApproximate(8));
+  ASSERT_FALSE(approx_gen.ShouldApproximate(4));
+
+  lod::lod_node* node = lod_node::lod_node_alloc();
+  node->tl = lod_node::lod_node_alloc();
+  node->tr = lod_node::lod_node_alloc();
+  node->bl = lod_node::lod_node_alloc();
+  node->br = lod_node::lod_node_alloc();
+  node->br->tl = lod_node::lod_node_alloc();
+  node->br->tr = lod_node::lod_node_alloc();
+  node->br->bl = lod_node::lod_node_alloc();
+  node->br->br = lod_node::lod_node_alloc();
+
+  lod_neighbours neighbours;
+  neighbours.Build(node, 1024, 0, 0, 512, 32);
+
+  sampler->samples = 0;
+  auto exact_chunk = Chunk::chunk_create(exact_gen, 0, 0, 0, 16, 32, neighbours);
+  size_t exact_samples = sampler->samples;
+
+  sampler->samples = 0;
+  ASSERT_TRUE(approx_gen.LoadHeightGridApproximate(-16, -16, 16, 35));
+  approx_gen.ClearHeightGrid();
+  sampler->samples = 0;
+  auto approx_chunk = Chunk::chunk_create(approx_gen, 0, 0, 0, 16, 32, neighbours);
+  EXPECT_LT(sampler->samples, exact_samples * 3 / 4);
+
+  for (int x = 0; x <= 32; x++) {
+    for (int y = 0; y <= 32; y++) {
+      Vertex& exact = exact_chunk->vertex_data[x * 33 + y];
+      Vertex& approx = approx_chunk->vertex_data[x * 33 + y];
+      EXPECT_NEAR(approx.position.y, exact.position.y, 0.05f);
+      if (x == 0 || y == 0 || x == 32 || y == 32) {
+        // borders are sampled in full, and have to match their neighbours
+        EXPECT_EQ(approx.position, exact.position);
+        EXPECT_EQ(approx.normal, exact.normal);
+      }
+    }
+  }
+
+  lod_node::lod_node_free(node);
+}
+
+TEST(ChunkGeneratorTest, ApproximateSamplingFallsBackOnRoughMaps) {
+  std::shared_ptr<CountingSampler> sampler = std::make_shared<CountingSampler>();
+  VertexGenerator<CountingSampler> exact_gen(sampler, 1.0f, (1.0 / 128.0), 32, 1024, glm::vec3(0));
+  VertexGenerator<CountingSampler> approx_gen(sampler, 1.0f, (1.0 / 128.0), 32, 1024, glm::vec3(0));
+  approx_gen.SetApproximateSampling({ 256, 2, 0.05f });
+
+  lod::lod_node* node = lod_node::lod_node_alloc();
+  node->tl = lod_node::lod_node_alloc();
+  node->tr = lod_node::lod_node_alloc();
+  node->bl = lod_node::lod_node_alloc();
+  node->br = lod_node::lod_node_alloc();
+
+  // too much going on between samples to interpolate
+  ASSERT_FALSE(approx_gen.LoadHeightGridApproximate(-16, -16, 16, 35));
+  approx_gen.ClearHeightGrid();
+
+  lod_neighbours neighbours;
+  neighbours.Build(node, 1024, 0, 0, 512, 32);
+  auto exact_chunk = Chunk::chunk_create(exact_gen, 0, 0, 0, 16, 32, neighbours);
+  auto approx_chunk = Chunk::chunk_create(approx_gen, 0, 0, 0, 16, 32, neighbours);
+  for (int i = 0; i < 33 * 33; i++) {
+    EXPECT_EQ(approx_chunk->vertex_data[i].position, exact_chunk->vertex_data[i].position);
+    EXPECT_EQ(approx_chunk->vertex_data[i].normal, exact_chunk->vertex_data[i].normal);
+  }
+
+  lod_node::lod_node_free(node);
+}
+
+struct PureSampler {
+  float Get(int x, int y) {
+    return static_cast<float>(16.0 * sin(x / 64.0) + 8.0 * cos(y / 32.0) + sin(0.125 * x));
+  }
+};
+
+TEST(ChunkGeneratorTest, ParallelGenerationMatchesSerial) {
+  std::shared_ptr<PureSampler> sampler = std::make_shared<PureSampler>();
+  ChunkGenerator<PureSampler> serial_generator(sampler, 1.0, (1.0 / 128.0), glm::vec3(3.0f, 1.5f, -2.0f), 16);
+  ChunkGenerator<PureSampler> parallel_generator(sampler, 1.0, (1.0 / 128.0), glm::vec3(3.0f, 1.5f, -2.0f), 16);
+  parallel_generator.SetThreadCount(4);
+
+  ApproximateSampling approximate { 256, 2, 0.5f };
+  serial_generator.SetApproximateSampling(approximate);
+  parallel_generator.SetApproximateSampling(approximate);
+
+  // fine in one corner, then the other, then coarse everywhere
+  lod::lod_node* trees[3];
+  for (int i = 0; i < 3; i++) {
+    trees[i] = lod_node::lod_node_alloc();
+    trees[i]->tl = lod_node::lod_node_alloc();
+    trees[i]->tr = lod_node::lod_node_alloc();
+    trees[i]->bl = lod_node::lod_node_alloc();
+    trees[i]->br = lod_node::lod_node_alloc();
+  }
+
+  for (lod::lod_node* quadrant : { trees[0]->bl, trees[1]->tr }) {
+    quadrant->tl = lod_node::lod_node_alloc();
+    quadrant->tr = lod_node::lod_node_alloc();
+    quadrant->bl = lod_node::lod_node_alloc();
+    quadrant->br = lod_node::lod_node_alloc();
+    quadrant->tr->tl = lod_node::lod_node_alloc();
+    quadrant->tr->tr = lod_node::lod_node_alloc();
+    quadrant->tr->bl = lod_node::lod_node_alloc();
+    quadrant->tr->br = lod_node::lod_node_alloc();
+  }
+
+  for (int i = 0; i < 3; i++) {
+    serial_generator.UpdateChunks(trees[i], 1024);
+    parallel_generator.UpdateChunks(trees[i], 1024);
+    ASSERT_EQ(parallel_generator.GetChunkCount(), serial_generator.GetChunkCount());
+
+    size_t vertex_bytes = serial_generator.GetVertexBufferSize();
+    ASSERT_EQ(parallel_generator.GetVertexBufferSize(), vertex_bytes);
+    std::vector<unsigned char> serial_vertices(vertex_bytes);
+    std::vector<unsigned char> parallel_vertices(vertex_bytes);
+    ASSERT_EQ(serial_generator.WriteVertexBuffer(serial_vertices.data(), vertex_bytes), vertex_bytes);
+    ASSERT_EQ(parallel_generator.WriteVertexBuffer(parallel_vertices.data(), vertex_bytes), vertex_bytes);
+    EXPECT_EQ(memcmp(serial_vertices.data(), parallel_vertices.data(), vertex_bytes), 0);
+  }
+
+  for (int i = 0; i < 3; i++) {
+    lod_node::lod_node_free(trees[i]);
+  }
+}
+
+// cancels a build once it's taken enough samples
+struct CancellingSampler {
+  float Get(int x, int y) {
+    if (samples == 0) {
+      first_x = x;
+      first_y = y;
+    }
+
+    if (++samples == budget) {
+      cancel->store(true);
+    }
+
+    return PureSampler().Get(x, y);
+  }
+
+  std::atomic<bool>* cancel = nullptr;
+  size_t budget = 0;
+  size_t samples = 0;
+  int first_x = 0;
+  int first_y = 0;
+};
+
+TEST(ChunkGeneratorTest, CancelledStageKeepsFinishedChunks) {
+  std::atomic<bool> cancel(false);
+  std::shared_ptr<CancellingSampler> sampler = std::make_shared<CancellingSampler>();
+  std::shared_ptr<CancellingSampler> reference_sampler = std::make_shared<CancellingSampler>();
+  sampler->cancel = &cancel;
+  sampler->budget = 19 * 19 * 2;
+  reference_sampler->cancel = &cancel;
+
+  ChunkGenerator<CancellingSampler> generator(sampler, 1.0, (1.0 / 128.0), glm::vec3(0.0f), 16);
+  ChunkGenerator<CancellingSampler> reference(reference_sampler, 1.0, (1.0 / 128.0), glm::vec3(0.0f), 16);
+
+  // fine in the bottom left, observer off in the top right
+  lod::lod_node* tree = lod_node::lod_node_alloc();
+  tree->tl = lod_node::lod_node_alloc();
+  tree->tr = lod_node::lod_node_alloc();
+  tree->bl = lod_node::lod_node_alloc();
+  tree->br = lod_node::lod_node_alloc();
+  tree->bl->tl = lod_node::lod_node_alloc();
+  tree->bl->tr = lod_node::lod_node_alloc();
+  tree->bl->bl = lod_node::lod_node_alloc();
+  tree->bl->br = lod_node::lod_node_alloc();
+  glm::vec3 observer(900.0f, 0.0f, 900.0f);
+
+  ASSERT_FALSE(generator.StageChunks(tree, 1024, observer, &cancel));
+  ASSERT_FALSE(generator.PublishChunks());
+  ASSERT_EQ(generator.GetChunkCount(), 0);
+
+  // nearest chunk went first, not the first in draw order
+  EXPECT_GE(sampler->first_x, 512 - 32);
+  EXPECT_GE(sampler->first_y, 512 - 32);
+
+  cancel.store(false);
+  sampler->budget = 0;
+  size_t samples_before = sampler->samples;
+  ASSERT_TRUE(generator.StageChunks(tree, 1024, observer, &cancel));
+  ASSERT_TRUE(generator.PublishChunks());
+  reference.UpdateChunks(tree, 1024, observer);
+
+  // finished chunks came from the cache the second time around
+  EXPECT_LT(sampler->samples - samples_before, reference_sampler->samples);
+
+  size_t vertex_bytes = reference.GetVertexBufferSize();
+  ASSERT_EQ(generator.GetVertexBufferSize(), vertex_bytes);
+  std::vector<unsigned char> expected(vertex_bytes);
+  std::vector<unsigned char> actual(vertex_bytes);
+  reference.WriteVertexBuffer(expected.data(), vertex_bytes);
+  generator.WriteVertexBuffer(actual.data(), vertex_bytes);
+  EXPECT_EQ(memcmp(expected.data(), actual.data(), vertex_bytes), 0);
+
+  lod_node::lod_node_free(tree);
+}
+
+TEST(ChunkGeneratorTest, BudgetedUpdateDrawsCachedAncestors) {
+  std::shared_ptr<PureSampler> sampler = std::make_shared<PureSampler>();
+  ChunkGenerator<PureSampler> generator(sampler, 1.0, (1.0 / 128.0), glm::vec3(0.0f), 16);
+  ChunkGenerator<PureSampler> reference(sampler, 1.0, (1.0 / 128.0), glm::vec3(0.0f), 16);
+
+  lod::lod_node* coarse = lod_node::lod_node_alloc();
+  coarse->tl = lod_node::lod_node_alloc();
+  coarse->tr = lod_node::lod_node_alloc();
+  coarse->bl = lod_node::lod_node_alloc();
+  coarse->br = lod_node::lod_node_alloc();
+
+  // bottom left refined twice over, where the observer is
+  lod::lod_node* fine = lod_node::lod_node_alloc();
+  fine->tl = lod_node::lod_node_alloc();
+  fine->tr = lod_node::lod_node_alloc();
+  fine->bl = lod_node::lod_node_alloc();
+  fine->br = lod_node::lod_node_alloc();
+  fine->bl->tl = lod_node::lod_node_alloc();
+  fine->bl->tr = lod_node::lod_node_alloc();
+  fine->bl->bl = lod_node::lod_node_alloc();
+  fine->bl->br = lod_node::lod_node_alloc();
+  fine->bl->bl->tl = lod_node::lod_node_alloc();
+  fine->bl->bl->tr = lod_node::lod_node_alloc();
+  fine->bl->bl->bl = lod_node::lod_node_alloc();
+  fine->bl->bl->br = lod_node::lod_node_alloc();
+  glm::vec3 observer(10.0f, 0.0f, 10.0f);
+
+  generator.UpdateChunks(coarse, 1024);
+  reference.UpdateChunks(coarse, 1024);
+  ASSERT_TRUE(generator.IsComplete());
+
+  size_t coarse_bytes = generator.GetVertexBufferSize();
+  std::vector<unsigned char> coarse_vertices(coarse_bytes);
+  generator.WriteVertexBuffer(coarse_vertices.data(), coarse_bytes);
+
+  // one new chunk isn't enough to finish anything in the bottom left - cached quadrant stands in for all of it
+  UpdateBudget budget;
+  budget.max_chunks = 1;
+  ASSERT_FALSE(generator.UpdateChunks(fine, 1024, observer, budget));
+  ASSERT_EQ(generator.GetChunkCount(), 4);
+
+  std::vector<unsigned char> placeholder_vertices(coarse_bytes);
+  generator.WriteVertexBuffer(placeholder_vertices.data(), coarse_bytes);
+  EXPECT_EQ(memcmp(coarse_vertices.data(), placeholder_vertices.data(), coarse_bytes), 0);
+
+  // 7 new leaves - the one above, plus one per call after it
+  int calls = 1;
+  bool complete = false;
+  while (!complete) {
+    complete = generator.UpdateChunks(fine, 1024, observer, budget);
+    calls++;
+    ASSERT_LT(calls, 16);
+  }
+
+  EXPECT_EQ(calls, 7);
+
+  reference.UpdateChunks(fine, 1024, observer);
+  size_t vertex_bytes = reference.GetVertexBufferSize();
+  ASSERT_EQ(generator.GetVertexBufferSize(), vertex_bytes);
+  std::vector<unsigned char> expected(vertex_bytes);
+  std::vector<unsigned char> actual(vertex_bytes);
+  reference.WriteVertexBuffer(expected.data(), vertex_bytes);
+  generator.WriteVertexBuffer(actual.data(), vertex_bytes);
+  EXPECT_EQ(memcmp(expected.data(), actual.data(), vertex_bytes), 0);
+
+  lod_node::lod_node_free(coarse);
+  lod_node::lod_node_free(fine);
+}
+
+TEST(ChunkGeneratorTest, BudgetedUpdateFallsBackToRoot) {
+  std::shared_ptr<PureSampler> sampler = std::make_shared<PureSampler>();
+  ChunkGenerator<PureSampler> generator(sampler, 1.0, (1.0 / 128.0), glm::vec3(0.0f), 16);
+
+  lod::lod_node* tree = lod_node::lod_node_alloc();
+  tree->tl = lod_node::lod_node_alloc();
+  tree->tr = lod_node::lod_node_alloc();
+  tree->bl = lod_node::lod_node_alloc();
+  tree->br = lod_node::lod_node_alloc();
+
+  // nothing cached - one leaf, plus the whole tree as a single placeholder
+  UpdateBudget budget;
+  budget.max_chunks = 1;
+  ASSERT_FALSE(generator.UpdateChunks(tree, 1024, glm::vec3(10.0f, 0.0f, 10.0f), budget));
+  ASSERT_EQ(generator.GetChunkCount(), 1);
+
+  ASSERT_FALSE(generator.UpdateChunks(tree, 1024, glm::vec3(10.0f, 0.0f, 10.0f), budget));
+  ASSERT_EQ(generator.GetChunkCount(), 1);
+
+  // unlimited budget finishes it off
+  ASSERT_TRUE(generator.UpdateChunks(tree, 1024, glm::vec3(10.0f, 0.0f, 10.0f), UpdateBudget()));
+  ASSERT_EQ(generator.GetChunkCount(), 4);
+
+  lod_node::lod_node_free(tree);
+}
+
+TEST(ChunkGeneratorTest, SharedCacheSkipsChunksBuiltElsewhere) {
+  std::atomic<bool> cancel(false);
+  std::shared_ptr<CancellingSampler> sampler = std::make_shared<CancellingSampler>();
+  sampler->cancel = &cancel;
+
+  ChunkGenerator<CancellingSampler> first(sampler, 1.0, (1.0 / 128.0), glm::vec3(0.0f), 16);
+  ChunkGenerator<CancellingSampler> second(sampler, 1.0, (1.0 / 128.0), glm::vec3(0.0f), 16);
+  second.SetChunkCache(first.GetChunkCache());
+  ASSERT_EQ(first.GetChunkCache(), second.GetChunkCache());
+
+  lod::lod_node* tree = lod_node::lod_node_alloc();
+  tree->tl = lod_node::lod_node_alloc();
+  tree->tr = lod_node::lod_node_alloc();
+  tree->bl = lod_node::lod_node_alloc();
+  tree->br = lod_node::lod_node_alloc();
+
+  first.UpdateChunks(tree, 1024);
+  size_t samples = sampler->samples;
+  ASSERT_GT(samples, 0);
+
+  // everything was already built by the first generator
+  second.UpdateChunks(tree, 1024);
+  EXPECT_EQ(sampler->samples, samples);
+  ASSERT_EQ(second.GetChunkCount(), 4);
+
+  size_t vertex_bytes = first.GetVertexBufferSize();
+  ASSERT_EQ(second.GetVertexBufferSize(), vertex_bytes);
+  std::vector<unsigned char> expected(vertex_bytes);
+  std::vector<unsigned char> actual(vertex_bytes);
+  first.WriteVertexBuffer(expected.data(), vertex_bytes);
+  second.WriteVertexBuffer(actual.data(), vertex_bytes);
+  EXPECT_EQ(memcmp(expected.data(), actual.data(), vertex_bytes), 0);
+
+  // detaching goes back to an empty cache of its own
+  second.SetChunkCache(nullptr);
+  ASSERT_NE(first.GetChunkCache(), second.GetChunkCache());
+  second.UpdateChunks(tree, 1024);
+  EXPECT_GT(sampler->samples, samples);
+
+  lod_node::lod_node_free(tree);
+}
+
+TEST(ChunkGeneratorTest, HeldSnapshotOutlivesEviction) {
+  std::shared_ptr<PureSampler> sampler = std::make_shared<PureSampler>();
+  ChunkGenerator<PureSampler> generator(sampler, 1.0, (1.0 / 128.0), glm::vec3(0.0f), 16);
+  generator.SetChunkCache(std::make_shared<ChunkGenerator<PureSampler>::ChunkCache>(4));
+
+  lod::lod_node* tree = lod_node::lod_node_alloc();
+  tree->tl = lod_node::lod_node_alloc();
+  tree->tr = lod_node::lod_node_alloc();
+  tree->bl = lod_node::lod_node_alloc();
+  tree->br = lod_node::lod_node_alloc();
+
+  generator.UpdateChunks(tree, 1024);
+  auto snapshot = generator.GetSnapshot();
+  ASSERT_EQ(snapshot->GetChunkCount(), 4);
+
+  size_t vertex_bytes = snapshot->GetVertexBufferSize();
+  std::vector<unsigned char> expected(vertex_bytes);
+  snapshot->WriteVertexBuffer(expected.data(), vertex_bytes);
+
+  // push every chunk of the snapshot out of the cache
+  for (size_t res = 2048; res <= 16384; res *= 2) {
+    generator.UpdateChunks(tree, res);
+  }
+
+  ASSERT_NE(generator.GetSnapshot(), snapshot);
+  ASSERT_EQ(snapshot->GetChunkCount(), 4);
+  std::vector<unsigned char> actual(vertex_bytes);
+  ASSERT_EQ(snapshot->WriteVertexBuffer(actual.data(), vertex_bytes), vertex_bytes);
+  EXPECT_EQ(memcmp(expected.data(), actual.data(), vertex_bytes), 0);
+
+  lod_node::lod_node_free(tree);
+}
+
+TEST(ChunkGeneratorTest, ParallelWritesMatchSerial) {
+  std::shared_ptr<PureSampler> sampler = std::make_shared<PureSampler>();
+  ChunkGenerator<PureSampler> serial_generator(sampler, 1.0, (1.0 / 128.0), glm::vec3(0.0f), 16);
+  ChunkGenerator<PureSampler> parallel_generator(sampler, 1.0, (1.0 / 128.0), glm::vec3(0.0f), 16);
+  parallel_generator.SetThreadCount(4);
+  parallel_generator.SetStreamingWrites(true);
+
+  lod::lod_node* tree = lod_node::lod_node_alloc();
+  tree->tl = lod_node::lod_node_alloc();
+  tree->tr = lod_node::lod_node_alloc();
+  tree->bl = lod_node::lod_node_alloc();
+  tree->br = lod_node::lod_node_alloc();
+  tree->bl->tl = lod_node::lod_node_alloc();
+  tree->bl->tr = lod_node::lod_node_alloc();
+  tree->bl->bl = lod_node::lod_node_alloc();
+  tree->bl->br = lod_node::lod_node_alloc();
+
+  serial_generator.UpdateChunks(tree, 1024);
+  parallel_generator.UpdateChunks(tree, 1024);
+  ASSERT_EQ(parallel_generator.GetChunkCount(), 7);
+
+  // whole buffers, then ones with room for part of the last chunk.
+  // parallel side is written one byte in, so streamed stores start unaligned
+  const size_t chunk_bytes = 17 * 17 * sizeof(Vertex);
+  for (size_t vertex_bytes : { 7 * chunk_bytes, 5 * chunk_bytes / 2 }) {
+    std::vector<unsigned char> serial_vertices(vertex_bytes);
+    std::vector<unsigned char> parallel_vertices(vertex_bytes + 1);
+    size_t written = serial_generator.WriteVertexBuffer(serial_vertices.data(), vertex_bytes);
+    ASSERT_EQ(written, (vertex_bytes / chunk_bytes) * chunk_bytes);
+    ASSERT_EQ(parallel_generator.WriteVertexBuffer(parallel_vertices.data() + 1, vertex_bytes), written);
+    EXPECT_EQ(memcmp(serial_vertices.data(), parallel_vertices.data() + 1, written), 0);
+  }
+
+  const size_t vertex_count = 7 * 17 * 17;
+  std::vector<glm::vec3> serial_positions(vertex_count), parallel_positions(vertex_count);
+  std::vector<glm::vec3> serial_normals(vertex_count), parallel_normals(vertex_count);
+  std::vector<glm::vec2> serial_texcoords(vertex_count), parallel_texcoords(vertex_count);
+  std::vector<glm::vec4> serial_tangents(vertex_count), parallel_tangents(vertex_count);
+  ASSERT_EQ(serial_generator.WriteVertexBufferSeparate(serial_positions.data(), serial_normals.data(), serial_texcoords.data(), serial_tangents.data(), vertex_count), vertex_count);
+  ASSERT_EQ(parallel_generator.WriteVertexBufferSeparate(parallel_positions.data(), parallel_normals.data(), parallel_texcoords.data(), parallel_tangents.data(), vertex_count), vertex_count);
+  EXPECT_EQ(memcmp(serial_positions.data(), parallel_positions.data(), vertex_count * sizeof(glm::vec3)), 0);
+  EXPECT_EQ(memcmp(serial_normals.data(), parallel_normals.data(), vertex_count * sizeof(glm::vec3)), 0);
+  EXPECT_EQ(memcmp(serial_texcoords.data(), parallel_texcoords.data(), vertex_count * sizeof(glm::vec2)), 0);
+  EXPECT_EQ(memcmp(serial_tangents.data(), parallel_tangents.data(), vertex_count * sizeof(glm::vec4)), 0);
+
+  // indices, whole and cut off partway through a chunk
+  const size_t quad_bytes = 6 * sizeof(unsigned int);
+  for (size_t index_bytes : { 7 * 16 * 16 * quad_bytes, 3 * 16 * 16 * quad_bytes + 37 * quad_bytes + 5 }) {
+    std::vector<unsigned int> parallel_indices(index_bytes / sizeof(unsigned int) + 1);
+    size_t written = parallel_generator.WriteIndexBuffer(parallel_indices.data(), index_bytes);
+    ASSERT_EQ(written, (index_bytes / quad_bytes) * quad_bytes);
+
+    std::vector<unsigned int> serial_indices(index_bytes / sizeof(unsigned int) + 1);
+    ASSERT_EQ(serial_generator.WriteIndexBuffer(serial_indices.data(), index_bytes), written);
+    EXPECT_EQ(memcmp(serial_indices.data(), parallel_indices.data(), written), 0);
+
+    // bl corner of the first quad in each chunk
+    for (size_t chunk = 0; chunk * 16 * 16 * quad_bytes < written; chunk++) {
+      EXPECT_EQ(parallel_indices[chunk * 16 * 16 * 6], chunk * 17 * 17);
+    }
+  }
+
+  lod_node::lod_node_free(tree);
+}
@@ -0,0 +1,59 @@
+#include <gtest/gtest.h>
+
+#include "util/DirectMappedCache.hpp"
+
+using namespace terraingen;
+using namespace util;
+
+TEST(DirectMappedCacheTest, SimpleStorageRecall) {
+  DirectMappedCache<int, int> cache(16);
+  int output_var;
+  ASSERT_FALSE(cache.Fetch(1, &output_var));
+
+  cache.Put(1, 10);
+  cache.Put(2, 20);
+  ASSERT_TRUE(cache.Has(1));
+  ASSERT_TRUE(cache.Fetch(1, &output_var));
+  ASSERT_EQ(output_var, 10);
+  ASSERT_TRUE(cache.Fetch(2, &output_var));
+  ASSERT_EQ(output_var, 20);
+
+  cache.Put(1, 16);
+  ASSERT_TRUE(cache.Fetch(1, &output_var));
+  ASSERT_EQ(output_var, 16);
+}
+
+TEST(DirectMappedCacheTest, CollisionReplaces) {
+  DirectMappedCache<int, int> cache(4);
+  ASSERT_EQ(cache.Capacity(), 4);
+
+  int output_var;
+  std::vector<int> keys;
+  // find two keys sharing a slot
+  for (int i = 0; i < 64; i++) {
+    cache.Clear();
+    cache.Put(0, 1);
+    cache.Put(i + 1, 2);
+    if (!cache.Has(0)) {
+      ASSERT_TRUE(cache.Fetch(i + 1, &output_var));
+      ASSERT_EQ(output_var, 2);
+      return;
+    }
+  }
+
+  FAIL() << "expected a collision in 4 slots";
+}
+
+TEST(DirectMappedCacheTest, ReserveRoundsUp) {
+  DirectMappedCache<int, int> cache(3);
+  ASSERT_EQ(cache.Capacity(), 4);
+
+  cache.Put(1, 1);
+  cache.Reserve(2);
+  ASSERT_EQ(cache.Capacity(), 4);
+  ASSERT_TRUE(cache.Has(1));
+
+  cache.Reserve(100);
+  ASSERT_EQ(cache.Capacity(), 128);
+  ASSERT_FALSE(cache.Has(1));
+}
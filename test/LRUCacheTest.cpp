@@ -71,4 +71,48 @@ TEST(LRUCacheTest, VerifyUnboundedIterator) {
   }
 
   ASSERT_EQ(i, 223);
-}
\ No newline at end of file
+}
+
+TEST(LRUCacheTest, PeekDoesNotRefresh) {
+  LRUCache<int, int> cache(4);
+  int output_var;
+  for (int i = 1; i <= 4; i++) {
+    cache.Put(i, i);
+  }
+
+  ASSERT_TRUE(cache.Peek(1, &output_var));
+  ASSERT_EQ(output_var, 1);
+  ASSERT_FALSE(cache.Peek(5, &output_var));
+
+  // 1 is still the oldest entry
+  CachePutResult result = cache.Put(5, 5, &output_var);
+  ASSERT_EQ(result, CachePutResult::REMOVE_LAST);
+  ASSERT_EQ(output_var, 1);
+}
+
+TEST(LRUCacheTest, EvictedKeysAreGone) {
+  LRUCache<int, int> cache(4);
+  int output_var;
+  for (int i = 1; i <= 6; i++) {
+    cache.Put(i, i * 10);
+  }
+
+  // 1 and 2 were pushed out
+  ASSERT_FALSE(cache.Has(1));
+  ASSERT_FALSE(cache.Has(2));
+  ASSERT_FALSE(cache.Peek(1, &output_var));
+  ASSERT_FALSE(cache.Peek(2, &output_var));
+  ASSERT_FALSE(cache.Fetch(2, &output_var));
+
+  for (int i = 3; i <= 6; i++) {
+    ASSERT_TRUE(cache.Peek(i, &output_var));
+    ASSERT_EQ(output_var, i * 10);
+  }
+
+  // same goes for the three argument put
+  CachePutResult result = cache.Put(7, 70, &output_var);
+  ASSERT_EQ(result, CachePutResult::REMOVE_LAST);
+  ASSERT_EQ(output_var, 30);
+  ASSERT_FALSE(cache.Has(3));
+  ASSERT_FALSE(cache.Peek(3, &output_var));
+}
@@ -2,8 +2,17 @@
 #include <gtest/gtest.h>
 
 #include "lod/LodTreeGenerator.hpp"
+#include "lod/lod_arena.hpp"
+#include "lod/lod_height_pyramid.hpp"
+#include "lod/lod_leaf_index.hpp"
 #include "util/HashList.hpp"
 
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <tuple>
+#include <vector>
+
 using namespace terraingen;
 using namespace lod;
 
@@ -51,4 +60,492 @@ TEST(LodTreeGeneratorTest, VerifyMinChunkSizeAtLocalPoint) {
   ASSERT_EQ(chunk_size_local, 16);
 
   lod_node::lod_node_free(node);
-}
\ No newline at end of file
+}
+
+TEST(LodTreeGeneratorTest, ChunkSizeFollowsQuadrants) {
+  lod_node* node = lod_node::lod_node_alloc();
+  node->bl = lod_node::lod_node_alloc();
+  node->br = lod_node::lod_node_alloc();
+  node->tl = lod_node::lod_node_alloc();
+  node->tr = lod_node::lod_node_alloc();
+
+  lod_node* child = node->br;
+  child->bl = lod_node::lod_node_alloc();
+  child->br = lod_node::lod_node_alloc();
+  child->tl = lod_node::lod_node_alloc();
+  child->tr = lod_node::lod_node_alloc();
+
+  ASSERT_EQ(lod_node::GetChunkSize(node, 128, glm::vec2(100.5, 10.5)), 32);
+  ASSERT_EQ(lod_node::GetChunkSize(node, 128, glm::vec2(64.5, 63.5)), 32);
+  ASSERT_EQ(lod_node::GetChunkSize(node, 128, glm::vec2(10.5, 100.5)), 64);
+  ASSERT_EQ(lod_node::GetChunkSize(node, 128, glm::vec2(63.5, 63.5)), 64);
+  ASSERT_EQ(lod_node::GetChunkSize(node, 128, glm::vec2(100.5, 100.5)), 64);
+
+  lod_node::lod_node_free(node);
+}
+
+TEST(LodTreeGeneratorTest, ChunkSizeLineMatchesPointLookup) {
+  std::shared_ptr<HeightMapTest> test = std::make_shared<HeightMapTest>();
+  LodTreeGenerator<HeightMapTest> generator(test, 256, 16);
+  generator.cascade_factor = 24.0f;
+
+  lod_node* node = generator.CreateLodTree(glm::vec3(90.0, 2.5, 170.0));
+
+  std::vector<size_t> output(70);
+  for (float fixed : { -0.5f, 0.5f, 63.5f, 64.5f, 127.5f, 128.5f, 200.5f, 256.5f }) {
+    for (size_t step : { 1, 2, 4 }) {
+      lod_node::GetChunkSizeLine(node, 256, glm::vec2(fixed, -0.5f), glm::vec2(0.0f, step), output.size(), output.data());
+      for (size_t i = 0; i < output.size(); i++) {
+        EXPECT_EQ(output[i], lod_node::GetChunkSize(node, 256, glm::vec2(fixed, -0.5f + i * step)));
+      }
+
+      lod_node::GetChunkSizeLine(node, 256, glm::vec2(0.5f, fixed), glm::vec2(step, 0.0f), output.size(), output.data());
+      for (size_t i = 0; i < output.size(); i++) {
+        EXPECT_EQ(output[i], lod_node::GetChunkSize(node, 256, glm::vec2(0.5f + i * step, fixed)));
+      }
+    }
+  }
+
+  lod_node::lod_node_free(node);
+}
+
+static size_t lod_node_count(const lod_node* node) {
+  if (node == nullptr) {
+    return 0;
+  }
+
+  return 1 + lod_node_count(node->bl) + lod_node_count(node->br) + lod_node_count(node->tl) + lod_node_count(node->tr);
+}
+
+TEST(LodTreeGeneratorTest, ArenaTreeMatchesHeapTree) {
+  std::shared_ptr<HeightMapTest> test = std::make_shared<HeightMapTest>();
+  LodTreeGenerator<HeightMapTest> generator(test, 256, 16);
+  generator.cascade_factor = 32.0f;
+
+  // small blocks, so trees span a few of them
+  lod_arena arena(16);
+  for (float offset : { 40.0f, 130.0f, 200.0f }) {
+    glm::vec3 local_point(offset, 2.5, 255.0f - offset);
+    lod_node* heap_tree = generator.CreateLodTree(local_point);
+
+    arena.Reset();
+    lod_node* arena_tree = generator.CreateLodTree(local_point, &arena);
+    lod_node_recurse_verify(arena_tree);
+    ASSERT_EQ(arena.GetNodeCount(), lod_node_count(heap_tree));
+
+    // siblings sit next to each other
+    ASSERT_NE(arena_tree->bl, nullptr);
+    EXPECT_EQ(arena_tree->br, arena_tree->bl + 1);
+    EXPECT_EQ(arena_tree->tl, arena_tree->bl + 2);
+    EXPECT_EQ(arena_tree->tr, arena_tree->bl + 3);
+
+    for (float y = 0.5f; y < 256.0f; y += 3.0f) {
+      for (float x = 0.5f; x < 256.0f; x += 3.0f) {
+        ASSERT_EQ(lod_node::GetChunkSize(arena_tree, 256, glm::vec2(x, y)), lod_node::GetChunkSize(heap_tree, 256, glm::vec2(x, y)));
+      }
+    }
+
+    lod_node::lod_node_free(heap_tree);
+  }
+}
+
+TEST(LodTreeGeneratorTest, ArenaReuseKeepsNodes) {
+  lod_arena arena(8);
+  lod_node* root = arena.Alloc();
+  arena.AllocChildren(root);
+  arena.AllocChildren(root->tr);
+  ASSERT_EQ(arena.GetNodeCount(), 9);
+
+  // same storage the second time around, all cleared out
+  arena.Reset();
+  ASSERT_EQ(arena.GetNodeCount(), 0);
+  lod_node* reused = arena.Alloc();
+  EXPECT_EQ(reused, root);
+  EXPECT_EQ(reused->bl, nullptr);
+  EXPECT_EQ(reused->tr, nullptr);
+}
+
+static void lod_collect_leaves(const lod_node* node, long x, long y, size_t size, std::vector<lod_leaf>* leaves) {
+  if (node->bl == nullptr) {
+    leaves->push_back({ x, y, size });
+    return;
+  }
+
+  long half = static_cast<long>(size / 2);
+  lod_collect_leaves(node->bl, x, y, size / 2, leaves);
+  lod_collect_leaves(node->br, x + half, y, size / 2, leaves);
+  lod_collect_leaves(node->tl, x, y + half, size / 2, leaves);
+  lod_collect_leaves(node->tr, x + half, y + half, size / 2, leaves);
+}
+
+static bool lod_leaf_less(const lod_leaf& a, const lod_leaf& b) {
+  return std::tie(a.x, a.y, a.size) < std::tie(b.x, b.y, b.size);
+}
+
+TEST(LodTreeGeneratorTest, IncrementalTreeMatchesRebuild) {
+  std::shared_ptr<HeightMapTest> test = std::make_shared<HeightMapTest>();
+  LodTreeGenerator<HeightMapTest> generator(test, 1024, 16);
+  generator.cascade_factor = 24.0f;
+
+  // leaves we think the tree has, kept up to date from diffs alone
+  std::vector<lod_leaf> tracked;
+  lod_tree_diff diff;
+  size_t unchanged = 0;
+
+  // mostly small steps, with the odd jump
+  glm::vec3 position(300.0f, 2.5f, 420.0f);
+  for (int i = 0; i < 400; i++) {
+    float step = (i % 50 == 49 ? 180.0f : 1.5f);
+    position.x = glm::clamp(position.x + step * std::cos(i * 0.05f), 0.0f, 1024.0f);
+    position.z = glm::clamp(position.z + step * std::sin(i * 0.031f), 0.0f, 1024.0f);
+
+    const lod_node* kept = generator.UpdateLodTree(position, &diff);
+    unchanged += (diff.Empty() ? 1 : 0);
+    for (const lod_leaf& leaf : diff.removed) {
+      auto itr = std::find(tracked.begin(), tracked.end(), leaf);
+      ASSERT_NE(itr, tracked.end());
+      tracked.erase(itr);
+    }
+
+    tracked.insert(tracked.end(), diff.added.begin(), diff.added.end());
+
+    lod_node* rebuilt = generator.CreateLodTree(position);
+    std::vector<lod_leaf> expected;
+    std::vector<lod_leaf> actual;
+    lod_collect_leaves(rebuilt, 0, 0, 1024, &expected);
+    lod_collect_leaves(kept, 0, 0, 1024, &actual);
+    lod_node::lod_node_free(rebuilt);
+
+    std::sort(expected.begin(), expected.end(), lod_leaf_less);
+    std::sort(actual.begin(), actual.end(), lod_leaf_less);
+    std::vector<lod_leaf> tracked_sorted = tracked;
+    std::sort(tracked_sorted.begin(), tracked_sorted.end(), lod_leaf_less);
+    ASSERT_EQ(actual, expected);
+    ASSERT_EQ(tracked_sorted, expected);
+  }
+
+  // small steps mostly leave the tree alone
+  EXPECT_GT(unchanged, 100);
+
+  // starting over reports everything as new
+  generator.ResetLodTree();
+  generator.UpdateLodTree(position, &diff);
+  EXPECT_TRUE(diff.removed.empty());
+  EXPECT_EQ(diff.added.size(), tracked.size());
+}
+
+TEST(LodTreeGeneratorTest, LeafIndexMatchesTreeLookup) {
+  std::shared_ptr<HeightMapTest> test = std::make_shared<HeightMapTest>();
+  LodTreeGenerator<HeightMapTest> generator(test, 512, 16);
+  generator.cascade_factor = 24.0f;
+
+  // nothing to find before the first build
+  lod_leaf_index index;
+  EXPECT_EQ(index.GetChunkSize(100, 100), 0u);
+  EXPECT_EQ(index.GetChunkSize(-5, 3, -1, 1), 0u);
+
+  for (float offset : { 10.0f, 250.0f, 500.0f }) {
+    lod_node* tree = generator.CreateLodTree(glm::vec3(offset, 2.5f, 512.0f - offset));
+    index.Build(tree, 512);
+
+    std::vector<lod_leaf> leaves;
+    lod_collect_leaves(tree, 0, 0, 512, &leaves);
+    ASSERT_EQ(index.GetLeafCount(), leaves.size());
+
+    // every half unit step around each vertex, including just outside the tree
+    for (long y = 0; y <= 512; y += 3) {
+      for (long x = 0; x <= 512; x += 3) {
+        for (int dir = 0; dir < 4; dir++) {
+          int dir_x = ((dir & 1) ? 1 : -1);
+          int dir_y = ((dir & 2) ? 1 : -1);
+          glm::vec2 point(x + 0.5f * dir_x, y + 0.5f * dir_y);
+          ASSERT_EQ(index.GetChunkSize(x, y, dir_x, dir_y), lod_node::GetChunkSize(tree, 512, point)) << x << ", " << y;
+        }
+      }
+    }
+
+    lod_node::lod_node_free(tree);
+  }
+
+  // empty tree
+  index.Build(nullptr, 512);
+  EXPECT_EQ(index.GetChunkSize(100, 100), lod_node::GetChunkSize(nullptr, 512, glm::vec2(100.5f, 100.5f)));
+}
+
+TEST(LodTreeGeneratorTest, InterleaveIsMortonOrder) {
+  EXPECT_EQ(lod_leaf_index::Interleave(0, 0), 0u);
+  EXPECT_EQ(lod_leaf_index::Interleave(1, 0), 1u);
+  EXPECT_EQ(lod_leaf_index::Interleave(0, 1), 2u);
+  EXPECT_EQ(lod_leaf_index::Interleave(3, 3), 15u);
+  EXPECT_EQ(lod_leaf_index::Interleave(0xFFFFFFFFu, 0), 0x5555555555555555ull);
+}
+
+// bumpy for x < 512, flat past it
+class HalfRoughHeightMap {
+public:
+  float Get(int x, int y) {
+    if (x >= 512) {
+      return 2.0f;
+    }
+
+    return 2.0f + 3.0f * std::sin(x * 0.7f) * std::cos(y * 0.45f);
+  }
+};
+
+TEST(LodTreeGeneratorTest, ScreenSpaceErrorKeepsFlatGroundCoarse) {
+  std::shared_ptr<HeightMapTest> test = std::make_shared<HeightMapTest>();
+  LodTreeGenerator<HeightMapTest> generator(test, 256, 16);
+  generator.cascade_factor = 32.0f;
+  glm::vec3 local_point(40.0, 2.5, 40.0);
+
+  lod_node* by_distance = generator.CreateLodTree(local_point);
+  EXPECT_GT(lod_node_count(by_distance), 1);
+  lod_node::lod_node_free(by_distance);
+
+  // nothing to gain from splitting a plane, however close we get
+  ScreenSpaceError sse;
+  sse.viewport_height = 1080.0;
+  generator.SetScreenSpaceError(sse);
+  lod_node* by_error = generator.CreateLodTree(local_point);
+  EXPECT_EQ(lod_node_count(by_error), 1);
+  lod_node::lod_node_free(by_error);
+
+  // and off again
+  generator.SetScreenSpaceError(ScreenSpaceError());
+  lod_node* off = generator.CreateLodTree(local_point);
+  EXPECT_GT(lod_node_count(off), 1);
+  lod_node::lod_node_free(off);
+}
+
+TEST(LodTreeGeneratorTest, ScreenSpaceErrorRefinesRoughGround) {
+  std::shared_ptr<HalfRoughHeightMap> test = std::make_shared<HalfRoughHeightMap>();
+  LodTreeGenerator<HalfRoughHeightMap> generator(test, 1024, 16);
+  generator.cascade_factor = 24.0f;
+
+  ScreenSpaceError sse;
+  sse.viewport_height = 720.0;
+  sse.max_pixels = 2.0;
+  generator.SetScreenSpaceError(sse);
+
+  // right on the seam, so both halves are just as far away
+  lod_node* tree = generator.CreateLodTree(glm::vec3(512.0f, 2.5f, 512.0f));
+  std::vector<lod_leaf> leaves;
+  lod_collect_leaves(tree, 0, 0, 1024, &leaves);
+  lod_node::lod_node_free(tree);
+
+  size_t rough = 0;
+  size_t flat = 0;
+  for (const lod_leaf& leaf : leaves) {
+    if (leaf.x + static_cast<long>(leaf.size) <= 512) {
+      rough++;
+    } else if (leaf.x >= 512) {
+      flat++;
+    }
+  }
+
+  EXPECT_GT(rough, flat * 4);
+  EXPECT_LE(flat, 2);
+}
+
+TEST(LodTreeGeneratorTest, ScreenSpaceErrorIncrementalMatchesRebuild) {
+  std::shared_ptr<HalfRoughHeightMap> test = std::make_shared<HalfRoughHeightMap>();
+  LodTreeGenerator<HalfRoughHeightMap> generator(test, 1024, 16);
+  generator.cascade_factor = 24.0f;
+
+  ScreenSpaceError sse;
+  sse.viewport_height = 720.0;
+  sse.max_pixels = 4.0;
+  generator.SetScreenSpaceError(sse);
+
+  glm::vec3 position(300.0f, 2.5f, 420.0f);
+  size_t unchanged = 0;
+  lod_tree_diff diff;
+  for (int i = 0; i < 200; i++) {
+    float step = (i % 50 == 49 ? 180.0f : 1.5f);
+    position.x = glm::clamp(position.x + step * std::cos(i * 0.05f), 0.0f, 1024.0f);
+    position.z = glm::clamp(position.z + step * std::sin(i * 0.031f), 0.0f, 1024.0f);
+
+    const lod_node* kept = generator.UpdateLodTree(position, &diff);
+    unchanged += (diff.Empty() ? 1 : 0);
+
+    lod_node* rebuilt = generator.CreateLodTree(position);
+    std::vector<lod_leaf> expected;
+    std::vector<lod_leaf> actual;
+    lod_collect_leaves(rebuilt, 0, 0, 1024, &expected);
+    lod_collect_leaves(kept, 0, 0, 1024, &actual);
+    lod_node::lod_node_free(rebuilt);
+
+    std::sort(expected.begin(), expected.end(), lod_leaf_less);
+    std::sort(actual.begin(), actual.end(), lod_leaf_less);
+    ASSERT_EQ(actual, expected);
+  }
+
+  EXPECT_GT(unchanged, 20);
+}
+
+// counts samples, to check what the pyramid measures
+class CountingHeightMap {
+public:
+  float Get(int x, int y) {
+    samples++;
+    return 0.25f * static_cast<float>((x * 7 + y * 13) % 31) + 0.01f * y;
+  }
+
+  size_t samples = 0;
+};
+
+TEST(LodTreeGeneratorTest, HeightPyramidMatchesSamples) {
+  std::shared_ptr<CountingHeightMap> test = std::make_shared<CountingHeightMap>();
+  lod_height_pyramid<CountingHeightMap> pyramid(test, 256, 16);
+
+  // one small node samples just what's under it, once
+  lod_height_bounds leaf = pyramid.GetBounds(32, 48, 16);
+  EXPECT_EQ(test->samples, 17u * 17u);
+  pyramid.GetBounds(32, 48, 16);
+  EXPECT_EQ(test->samples, 17u * 17u);
+  EXPECT_LE(leaf.min, leaf.max);
+
+  // so does the root - a chunk and its children's vertices, not the whole map
+  test->samples = 0;
+  lod_height_bounds root_level = pyramid.GetLevelBounds(0, 0, 256);
+  EXPECT_EQ(test->samples, 33u * 33u);
+
+  // top down, the way a tree reaches them
+  std::vector<lod_height_bounds> level_bounds;
+  for (int node_size : { 256, 128, 64, 32, 16 }) {
+    for (int y = 0; y < 256; y += node_size) {
+      for (int x = 0; x < 256; x += node_size) {
+        level_bounds.push_back(pyramid.GetLevelBounds(x, y, node_size));
+      }
+    }
+  }
+
+  // with everything below measured, bounds are exact
+  size_t level_index = 0;
+  for (int node_size : { 256, 128, 64, 32, 16 }) {
+    for (int y = 0; y < 256; y += node_size) {
+      for (int x = 0; x < 256; x += node_size) {
+        float lo = std::numeric_limits<float>::infinity();
+        float hi = -std::numeric_limits<float>::infinity();
+        for (int j = 0; j <= node_size; j++) {
+          for (int i = 0; i <= node_size; i++) {
+            lo = std::min(lo, test->Get(x + i, y + j));
+            hi = std::max(hi, test->Get(x + i, y + j));
+          }
+        }
+
+        lod_height_bounds bounds = pyramid.GetBounds(x, y, node_size);
+        ASSERT_EQ(bounds.min, lo);
+        ASSERT_EQ(bounds.max, hi);
+
+        // level bounds stay where they were
+        lod_height_bounds level = pyramid.GetLevelBounds(x, y, node_size);
+        ASSERT_EQ(level.min, level_bounds[level_index].min);
+        ASSERT_EQ(level.max, level_bounds[level_index].max);
+        level_index++;
+      }
+    }
+  }
+
+  EXPECT_EQ(pyramid.GetLevelBounds(0, 0, 256).min, root_level.min);
+
+  // smallest nodes never split, so they have nothing to lose
+  EXPECT_EQ(pyramid.GetError(0, 0, 16), 0.0);
+  EXPECT_GT(pyramid.GetError(0, 0, 32), 0.0);
+
+  // level bounds cover the node's own vertices, and a margin for what finer levels add
+  EXPECT_LE(root_level.min, pyramid.GetBounds(0, 0, 256).min + 1e-4f);
+  EXPECT_GE(root_level.max, pyramid.GetBounds(0, 0, 256).max - 1e-4f);
+}
+
+// flat, but for one sample sticking way up, off every coarse sampling grid
+class SpikeHeightMap {
+public:
+  float Get(int x, int y) { return (x == 601 && y == 603 ? 500.0f : 0.0f); }
+};
+
+TEST(LodTreeGeneratorTest, HeightPyramidEstimatesMissNarrowSpikes) {
+  std::shared_ptr<SpikeHeightMap> test = std::make_shared<SpikeHeightMap>();
+  lod_height_pyramid<SpikeHeightMap> pyramid(test, 1024, 16);
+
+  // coarse nodes only see their own sample grid, and the spike falls between samples.
+  // level bounds are an estimate, and this is what they can miss
+  EXPECT_LT(pyramid.GetLevelBounds(0, 0, 1024).max, 500.0f);
+  EXPECT_LT(pyramid.GetLevelBounds(576, 576, 64).max, 500.0f);
+
+  // nodes fine enough to sample every height cover it
+  EXPECT_EQ(pyramid.GetBounds(592, 592, 16).max, 500.0f);
+  EXPECT_GE(pyramid.GetLevelBounds(576, 576, 32).max, 500.0f);
+
+  // and coarser ones pick it up from below, once everything under them is measured
+  for (int node_size : { 32, 16 }) {
+    for (int y = 576; y < 640; y += node_size) {
+      for (int x = 576; x < 640; x += node_size) {
+        pyramid.GetBounds(x, y, node_size);
+      }
+    }
+  }
+
+  EXPECT_EQ(pyramid.GetBounds(576, 576, 64).max, 500.0f);
+  EXPECT_LT(pyramid.GetLevelBounds(576, 576, 64).max, 500.0f);
+}
+
+class FlatHeightMap {
+public:
+  float Get(int x, int y) { return 0.0f; }
+};
+
+TEST(LodTreeGeneratorTest, HeightBoundsCountHeightAsDistance) {
+  std::shared_ptr<FlatHeightMap> test = std::make_shared<FlatHeightMap>();
+  LodTreeGenerator<FlatHeightMap> generator(test, 1024, 16);
+  generator.cascade_factor = 24.0f;
+
+  // well above the ground
+  glm::vec3 local_point(500.0f, 300.0f, 500.0f);
+  lod_node* footprint = generator.CreateLodTree(local_point);
+
+  generator.SetHeightBounds(true);
+  lod_node* bounded = generator.CreateLodTree(local_point);
+  EXPECT_LT(lod_node_count(bounded), lod_node_count(footprint));
+
+  // on the ground, both agree
+  glm::vec3 ground_point(500.0f, 0.0f, 500.0f);
+  lod_node* on_ground = generator.CreateLodTree(ground_point);
+  generator.SetHeightBounds(false);
+  lod_node* on_ground_footprint = generator.CreateLodTree(ground_point);
+  EXPECT_EQ(lod_node_count(on_ground), lod_node_count(on_ground_footprint));
+
+  lod_node::lod_node_free(footprint);
+  lod_node::lod_node_free(bounded);
+  lod_node::lod_node_free(on_ground);
+  lod_node::lod_node_free(on_ground_footprint);
+}
+
+TEST(LodTreeGeneratorTest, HeightBoundsIncrementalMatchesRebuild) {
+  std::shared_ptr<HalfRoughHeightMap> test = std::make_shared<HalfRoughHeightMap>();
+  LodTreeGenerator<HalfRoughHeightMap> generator(test, 1024, 16);
+  generator.cascade_factor = 24.0f;
+  generator.SetHeightBounds(true);
+
+  // climbing and falling as well as moving around
+  glm::vec3 position(300.0f, 2.5f, 420.0f);
+  lod_tree_diff diff;
+  for (int i = 0; i < 200; i++) {
+    float step = (i % 50 == 49 ? 180.0f : 1.5f);
+    position.x = glm::clamp(position.x + step * std::cos(i * 0.05f), 0.0f, 1024.0f);
+    position.z = glm::clamp(position.z + step * std::sin(i * 0.031f), 0.0f, 1024.0f);
+    position.y = 2.5f + 40.0f * std::sin(i * 0.07f);
+
+    const lod_node* kept = generator.UpdateLodTree(position, &diff);
+    lod_node* rebuilt = generator.CreateLodTree(position);
+    std::vector<lod_leaf> expected;
+    std::vector<lod_leaf> actual;
+    lod_collect_leaves(rebuilt, 0, 0, 1024, &expected);
+    lod_collect_leaves(kept, 0, 0, 1024, &actual);
+    lod_node::lod_node_free(rebuilt);
+
+    std::sort(expected.begin(), expected.end(), lod_leaf_less);
+    std::sort(actual.begin(), actual.end(), lod_leaf_less);
+    ASSERT_EQ(actual, expected);
+  }
+}
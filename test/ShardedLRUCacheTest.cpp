@@ -0,0 +1,97 @@
+#include <gtest/gtest.h>
+
+#include "util/ShardedLRUCache.hpp"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+using namespace terraingen;
+using namespace util;
+
+TEST(ShardedLRUCacheTest, SimpleStorageRecall) {
+  ShardedLRUCache<int, int> cache(64);
+  for (int i = 0; i < 32; i++) {
+    cache.Put(i, i * 2);
+  }
+
+  for (int i = 0; i < 32; i++) {
+    int output = -1;
+    ASSERT_TRUE(cache.Fetch(i, &output));
+    ASSERT_EQ(output, i * 2);
+    ASSERT_TRUE(cache.Has(i));
+  }
+
+  int output = -1;
+  ASSERT_FALSE(cache.Peek(100, &output));
+  ASSERT_EQ(output, -1);
+
+  ASSERT_EQ(cache.Put(3, 7, &output), CachePutResult::OVERWRITE);
+  ASSERT_EQ(output, 6);
+}
+
+TEST(ShardedLRUCacheTest, SingleShardIsPlainLRU) {
+  ShardedLRUCache<int, int, 1> cache(4);
+  int output;
+  cache.Put(1, 1);
+  cache.Put(2, 2);
+  cache.Put(3, 3);
+  cache.Put(4, 4);
+
+  // 1 is most recent now, so 2 goes
+  ASSERT_TRUE(cache.Fetch(1, &output));
+  ASSERT_EQ(cache.Put(5, 5, &output), CachePutResult::REMOVE_LAST);
+  ASSERT_EQ(output, 2);
+
+  // peeking doesn't save 3
+  ASSERT_TRUE(cache.Peek(3, &output));
+  ASSERT_EQ(cache.Put(6, 6, &output), CachePutResult::REMOVE_LAST);
+  ASSERT_EQ(output, 3);
+}
+
+TEST(ShardedLRUCacheTest, CapacityIsRoughlyRespected) {
+  ShardedLRUCache<int, int> cache(256);
+  for (int i = 0; i < 4096; i++) {
+    cache.Put(i, i);
+  }
+
+  int held = 0;
+  int output;
+  for (int i = 0; i < 4096; i++) {
+    held += (cache.Peek(i, &output) ? 1 : 0);
+  }
+
+  // slack per shard, but nowhere near everything
+  ASSERT_GE(held, 256);
+  ASSERT_LT(held, 512);
+
+  // growing keeps the most recent entries
+  cache.AddCapacity(256);
+  ASSERT_EQ(cache.Capacity(), 512);
+  ASSERT_TRUE(cache.Peek(4095, &output));
+}
+
+TEST(ShardedLRUCacheTest, ConcurrentAccess) {
+  ShardedLRUCache<int, int> cache(1024);
+  std::atomic<int> mismatches(0);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; t++) {
+    threads.emplace_back([&cache, &mismatches, t] {
+      for (int i = 0; i < 20000; i++) {
+        int key = (i * 7 + t * 13) % 2048;
+        int output;
+        if (cache.Fetch(key, &output) && output != key * 3) {
+          mismatches++;
+        }
+
+        cache.Put(key, key * 3);
+      }
+    });
+  }
+
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  ASSERT_EQ(mismatches.load(), 0);
+}
@@ -5,6 +5,11 @@
 
 #include "TerrainGenerator.hpp"
 
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <thread>
+
 using namespace terraingen;
 
 struct DummySampler {
@@ -91,4 +96,351 @@ TEST(TerrainGeneratorTest, RespectOffsetInTreeGen) {
 
   ASSERT_EQ(chunks_border, chunks_opposite_border);
   ASSERT_GT(chunks, chunks_border);
-}
\ No newline at end of file
+}
+
+TEST(TerrainGeneratorTest, HeightBoundsRespectVerticalOffset) {
+  std::shared_ptr<DummySampler> sampler = std::make_shared<DummySampler>();
+
+  // vertices come out at their height + 300, so an observer at 300 is standing on the ground
+  TerrainGenerator raised(sampler, 4.0f, (1.0 / 2048.0), glm::vec3(0.0, -300.0, 0.0), 2048, 64, 256.0);
+  raised.SetHeightBounds(true);
+  TerrainGenerator footprint(sampler, 4.0f, (1.0 / 2048.0), glm::vec3(0.0), 2048, 64, 256.0);
+
+  for (float x : { 300.0f, 1024.0f, 1700.0f }) {
+    raised.UpdateChunkData(glm::vec3(x, 300.0f, 900.0f));
+    footprint.UpdateChunkData(glm::vec3(x, 0.0f, 900.0f));
+    EXPECT_EQ(raised.GetChunkCount(), footprint.GetChunkCount());
+
+    // hundreds of units up, on the other hand, coarsens things
+    raised.UpdateChunkData(glm::vec3(x, 800.0f, 900.0f));
+    EXPECT_LT(raised.GetChunkCount(), footprint.GetChunkCount());
+  }
+}
+
+TEST(TerrainGeneratorTest, AsyncUpdateKeepsOutputsUntilPublished) {
+  std::shared_ptr<DummySampler> sampler = std::make_shared<DummySampler>();
+  TerrainGenerator generator(sampler, 4.0f, (1.0 / 2048.0), glm::vec3(0.0), 2048, 64, 256.0);
+  TerrainGenerator reference(sampler, 4.0f, (1.0 / 2048.0), glm::vec3(0.0), 2048, 64, 256.0);
+
+  generator.UpdateChunkData(glm::vec3(1024.0, 0.0, 1024.0));
+  size_t chunks_before = generator.GetChunkCount();
+  std::vector<terrain::Vertex> before(chunks_before * 65 * 65);
+  generator.WriteVertexBuffer(before.data(), before.size() * sizeof(terrain::Vertex));
+
+  // everything read before publishing is the old set, whether or not the worker has finished
+  generator.UpdateChunkDataAsync(glm::vec3(0.0));
+  std::vector<terrain::Vertex> during(chunks_before * 65 * 65);
+  ASSERT_EQ(generator.GetChunkCount(), chunks_before);
+  generator.WriteVertexBuffer(during.data(), during.size() * sizeof(terrain::Vertex));
+  EXPECT_EQ(memcmp(before.data(), during.data(), before.size() * sizeof(terrain::Vertex)), 0);
+
+  generator.WaitChunkData();
+  EXPECT_FALSE(generator.PollChunkData());
+
+  // same history, same cache contents
+  reference.UpdateChunkData(glm::vec3(1024.0, 0.0, 1024.0));
+  reference.UpdateChunkData(glm::vec3(0.0));
+  size_t chunks = reference.GetChunkCount();
+  ASSERT_EQ(generator.GetChunkCount(), chunks);
+
+  std::vector<terrain::Vertex> expected(chunks * 65 * 65);
+  std::vector<terrain::Vertex> actual(chunks * 65 * 65);
+  reference.WriteVertexBuffer(expected.data(), expected.size() * sizeof(terrain::Vertex));
+  generator.WriteVertexBuffer(actual.data(), actual.size() * sizeof(terrain::Vertex));
+  EXPECT_EQ(memcmp(expected.data(), actual.data(), expected.size() * sizeof(terrain::Vertex)), 0);
+
+  // only the latest request has to land
+  generator.UpdateChunkDataAsync(glm::vec3(1024.0, 0.0, 1024.0));
+  generator.UpdateChunkDataAsync(glm::vec3(512.0, 0.0, 256.0));
+  generator.WaitChunkData();
+  reference.UpdateChunkData(glm::vec3(512.0, 0.0, 256.0));
+  EXPECT_EQ(generator.GetChunkCount(), reference.GetChunkCount());
+
+  // sync updates still work alongside the worker
+  generator.UpdateChunkDataAsync(glm::vec3(1024.0, 0.0, 1024.0));
+  generator.UpdateChunkData(glm::vec3(0.0));
+  reference.UpdateChunkData(glm::vec3(0.0));
+  EXPECT_EQ(generator.GetChunkCount(), reference.GetChunkCount());
+  generator.WaitChunkData();
+}
+
+TEST(TerrainGeneratorTest, AsyncUpdateRunsOnExecutor) {
+  std::shared_ptr<DummySampler> sampler = std::make_shared<DummySampler>();
+  std::shared_ptr<util::WorkStealingPool> pool = std::make_shared<util::WorkStealingPool>(2);
+  TerrainGenerator generator(sampler, 4.0f, (1.0 / 2048.0), glm::vec3(0.0), 2048, 64, 256.0);
+  TerrainGenerator reference(sampler, 4.0f, (1.0 / 2048.0), glm::vec3(0.0), 2048, 64, 256.0);
+  generator.SetExecutor(pool);
+
+  generator.UpdateChunkDataAsync(glm::vec3(1024.0, 0.0, 1024.0));
+  generator.WaitChunkData();
+  generator.UpdateChunkDataAsync(glm::vec3(0.0));
+  while (!generator.PollChunkData()) {
+    std::this_thread::yield();
+  }
+
+  reference.UpdateChunkData(glm::vec3(1024.0, 0.0, 1024.0));
+  reference.UpdateChunkData(glm::vec3(0.0));
+  size_t chunks = reference.GetChunkCount();
+  ASSERT_EQ(generator.GetChunkCount(), chunks);
+
+  std::vector<terrain::Vertex> expected(chunks * 65 * 65);
+  std::vector<terrain::Vertex> actual(chunks * 65 * 65);
+  reference.WriteVertexBuffer(expected.data(), expected.size() * sizeof(terrain::Vertex));
+  generator.WriteVertexBuffer(actual.data(), actual.size() * sizeof(terrain::Vertex));
+  EXPECT_EQ(memcmp(expected.data(), actual.data(), expected.size() * sizeof(terrain::Vertex)), 0);
+}
+
+// holds up sampling until opened, and counts samples in the top right corner
+struct GatedSampler {
+  float Get(float x, float y) {
+    waiting.store(true);
+    while (!open.load()) {
+      std::this_thread::yield();
+    }
+
+    if (x >= 1536.0f && y >= 1536.0f) {
+      corner_samples++;
+    }
+
+    return sin(0.5 * x + 0.4 * y);
+  }
+
+  std::atomic<bool> open { true };
+  std::atomic<bool> waiting { false };
+  std::atomic<size_t> corner_samples { 0 };
+};
+
+TEST(TerrainGeneratorTest, SyncUpdateDropsQueuedAsyncRequest) {
+  std::shared_ptr<GatedSampler> sampler = std::make_shared<GatedSampler>();
+  std::shared_ptr<GatedSampler> reference_sampler = std::make_shared<GatedSampler>();
+  TerrainGenerator generator(sampler, 4.0f, (1.0 / 2048.0), glm::vec3(0.0), 2048, 64, 256.0);
+  TerrainGenerator reference(reference_sampler, 4.0f, (1.0 / 2048.0), glm::vec3(0.0), 2048, 64, 256.0);
+
+  // one update stuck building, another queued behind it, out in the corner
+  sampler->open.store(false);
+  generator.UpdateChunkDataAsync(glm::vec3(256.0, 0.0, 256.0));
+  while (!sampler->waiting.load()) {
+    std::this_thread::yield();
+  }
+
+  generator.UpdateChunkDataAsync(glm::vec3(1900.0, 0.0, 1900.0));
+  std::thread update([&] { generator.UpdateChunkData(glm::vec3(256.0, 0.0, 256.0)); });
+
+  // give the sync update time to start waiting on the background one
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  sampler->open.store(true);
+  update.join();
+
+  // the queued request never got built - the corner only saw what the sync update needed
+  reference.UpdateChunkData(glm::vec3(256.0, 0.0, 256.0));
+  EXPECT_EQ(sampler->corner_samples.load(), reference_sampler->corner_samples.load());
+  EXPECT_EQ(generator.GetChunkCount(), reference.GetChunkCount());
+  generator.WaitChunkData();
+  EXPECT_EQ(generator.GetChunkCount(), reference.GetChunkCount());
+}
+
+TEST(TerrainGeneratorTest, BudgetedUpdateConverges) {
+  std::shared_ptr<DummySampler> sampler = std::make_shared<DummySampler>();
+  TerrainGenerator generator(sampler, 4.0f, (1.0 / 2048.0), glm::vec3(0.0), 2048, 64, 256.0);
+  TerrainGenerator reference(sampler, 4.0f, (1.0 / 2048.0), glm::vec3(0.0), 2048, 64, 256.0);
+
+  terrain::UpdateBudget budget;
+  budget.max_chunks = 8;
+  int calls = 0;
+  while (!generator.UpdateChunkData(glm::vec3(512.0, 0.0, 512.0), budget)) {
+    EXPECT_GT(generator.GetChunkCount(), 0);
+    ASSERT_LT(++calls, 256);
+  }
+
+  EXPECT_GT(calls, 0);
+  reference.UpdateChunkData(glm::vec3(512.0, 0.0, 512.0));
+  EXPECT_EQ(generator.GetChunkCount(), reference.GetChunkCount());
+}
+
+struct CountingSampler {
+  float Get(float x, float y) {
+    samples++;
+    return sin(0.5 * x + 0.4 * y);
+  }
+
+  std::atomic<size_t> samples { 0 };
+};
+
+TEST(TerrainGeneratorTest, PrefetchAlongVelocity) {
+  std::shared_ptr<CountingSampler> sampler = std::make_shared<CountingSampler>();
+  std::shared_ptr<CountingSampler> reference_sampler = std::make_shared<CountingSampler>();
+  TerrainGenerator generator(sampler, 4.0f, (1.0 / 2048.0), glm::vec3(0.0), 2048, 64, 256.0);
+  TerrainGenerator reference(reference_sampler, 4.0f, (1.0 / 2048.0), glm::vec3(0.0), 2048, 64, 256.0);
+
+  terrain::PrefetchSettings settings;
+  settings.lookahead = { 0.5f, 1.0f };
+  generator.SetPrefetchSettings(settings);
+
+  glm::vec3 velocity(300.0, 0.0, 100.0);
+  generator.UpdateChunkData(glm::vec3(256.0, 0.0, 512.0), velocity);
+  reference.UpdateChunkData(glm::vec3(256.0, 0.0, 512.0));
+  size_t chunks = reference.GetChunkCount();
+  ASSERT_EQ(generator.GetChunkCount(), chunks);
+
+  // arriving where we predicted - everything's already built
+  size_t samples = sampler->samples;
+  size_t reference_samples = reference_sampler->samples;
+  generator.UpdateChunkData(glm::vec3(556.0, 0.0, 612.0));
+  reference.UpdateChunkData(glm::vec3(556.0, 0.0, 612.0));
+  EXPECT_GT(reference_sampler->samples, reference_samples);
+  EXPECT_EQ(sampler->samples, samples);
+  EXPECT_EQ(generator.GetChunkCount(), reference.GetChunkCount());
+
+  // same again in the background
+  generator.UpdateChunkDataAsync(glm::vec3(556.0, 0.0, 612.0), -velocity);
+  generator.WaitChunkData();
+
+  // waits out the background prefetch
+  generator.PrefetchChunkData({});
+  samples = sampler->samples;
+  generator.UpdateChunkData(glm::vec3(256.0, 0.0, 512.0));
+  EXPECT_EQ(sampler->samples, samples);
+
+  // budget caps how much we look ahead
+  settings.budget.max_chunks = 3;
+  generator.SetPrefetchSettings(settings);
+  EXPECT_LE(generator.PrefetchChunkData({ glm::vec3(1500.0, 0.0, 1500.0), glm::vec3(1800.0, 0.0, 200.0) }), 3);
+}
+
+TEST(TerrainGeneratorTest, MultipleObserversShareChunks) {
+  std::shared_ptr<CountingSampler> sampler = std::make_shared<CountingSampler>();
+  std::shared_ptr<CountingSampler> single_sampler = std::make_shared<CountingSampler>();
+  TerrainGenerator generator(sampler, 4.0f, (1.0 / 2048.0), glm::vec3(0.0), 2048, 64, 256.0);
+
+  std::vector<glm::vec3> observers = { glm::vec3(512.0, 0.0, 512.0), glm::vec3(1536.0, 0.0, 1536.0), glm::vec3(512.0, 0.0, 512.0) };
+  generator.UpdateChunkData(observers);
+  ASSERT_EQ(generator.GetViewCount(), 3);
+
+  // each view matches what a lone observer would see, seams included
+  size_t separate_samples = 0;
+  for (size_t view = 0; view < observers.size(); view++) {
+    TerrainGenerator lone(single_sampler, 4.0f, (1.0 / 2048.0), glm::vec3(0.0), 2048, 64, 256.0);
+    size_t before = single_sampler->samples;
+    lone.UpdateChunkData(observers[view]);
+    separate_samples += single_sampler->samples - before;
+
+    ASSERT_EQ(generator.GetChunkCount(view), lone.GetChunkCount());
+    ASSERT_EQ(generator.GetVertexBufferSize(view), lone.GetVertexBufferSize());
+    EXPECT_EQ(generator.GetIndexBufferSize(view), lone.GetIndexBufferSize());
+
+    size_t vertex_bytes = lone.GetVertexBufferSize();
+    std::vector<unsigned char> expected(vertex_bytes);
+    std::vector<unsigned char> actual(vertex_bytes);
+    lone.WriteVertexBuffer(expected.data(), vertex_bytes);
+    generator.WriteVertexBuffer(actual.data(), vertex_bytes, view);
+    EXPECT_EQ(memcmp(expected.data(), actual.data(), vertex_bytes), 0) << "view " << view;
+  }
+
+  // identical observers cost nothing extra, and far apart ones still share the coarse chunks
+  EXPECT_LT(sampler->samples, separate_samples * 2 / 3);
+
+  // same spots again - everything comes from the cache, differently stitched copies included
+  size_t samples = sampler->samples;
+  generator.UpdateChunkData(observers);
+  EXPECT_EQ(sampler->samples, samples);
+
+  // and back down to one, in the background
+  generator.UpdateChunkDataAsync(std::vector<glm::vec3> { observers[1] });
+  generator.WaitChunkData();
+  EXPECT_EQ(generator.GetViewCount(), 1);
+  EXPECT_EQ(generator.GetChunkCount(1), 0);
+}
+
+TEST(TerrainGeneratorTest, SnapshotReadersRunAlongsideUpdates) {
+  std::shared_ptr<DummySampler> sampler = std::make_shared<DummySampler>();
+  TerrainGenerator generator(
+    sampler,
+    4.0f,
+    (1.0 / 2048.0),
+    glm::vec3(0.0),
+    2048,
+    16,
+    4.0
+  );
+
+  generator.UpdateChunkData(glm::vec3(128.0, 0.0, 128.0));
+
+  // reads whole snapshots while the main thread keeps publishing new ones
+  std::atomic<bool> stop(false);
+  std::atomic<int> mismatches(0);
+  std::atomic<int> reads(0);
+  std::thread reader([&] {
+    std::vector<unsigned char> vertices;
+    std::vector<unsigned char> again;
+    while (!stop.load() || reads.load() == 0) {
+      auto snapshot = generator.GetSnapshot();
+      size_t vertex_bytes = snapshot->GetVertexBufferSize();
+      vertices.resize(vertex_bytes);
+      if (snapshot->WriteVertexBuffer(vertices.data(), vertex_bytes) != vertex_bytes) {
+        mismatches++;
+      }
+
+      // whatever got published meanwhile, our snapshot reads the same
+      std::this_thread::yield();
+      again.resize(vertex_bytes);
+      snapshot->WriteVertexBuffer(again.data(), vertex_bytes);
+      if (memcmp(vertices.data(), again.data(), vertex_bytes) != 0) {
+        mismatches++;
+      }
+
+      reads++;
+      std::this_thread::yield();
+    }
+  });
+
+  for (int i = 0; i < 24; i++) {
+    generator.UpdateChunkData(glm::vec3(128.0 + 160.0 * i, 0.0, 128.0 + 96.0 * i));
+  }
+
+  stop.store(true);
+  reader.join();
+  EXPECT_GT(reads.load(), 0);
+  EXPECT_EQ(mismatches.load(), 0);
+}
+
+TEST(TerrainGeneratorTest, SmallMovesSkipRebuilding) {
+  std::shared_ptr<DummySampler> sampler = std::make_shared<DummySampler>();
+  TerrainGenerator generator(
+    sampler,
+    4.0f,
+    (1.0 / 2048.0),
+    glm::vec3(0.0),
+    2048,
+    64,
+    16.0
+  );
+
+  generator.UpdateChunkData(glm::vec3(1000.0, 0.0, 1000.0));
+  auto snapshot = generator.GetSnapshot();
+
+  // a few centimetres doesn't change any leaf - nothing gets staged or published
+  generator.UpdateChunkData(glm::vec3(1000.05, 0.0, 1000.02));
+  EXPECT_EQ(generator.GetSnapshot(), snapshot);
+
+  generator.UpdateChunkDataAsync(glm::vec3(1000.1, 0.0, 999.97));
+  generator.WaitChunkData();
+  EXPECT_EQ(generator.GetSnapshot(), snapshot);
+
+  // far enough to change the tree
+  generator.UpdateChunkData(glm::vec3(1600.0, 0.0, 400.0));
+  EXPECT_NE(generator.GetSnapshot(), snapshot);
+  EXPECT_GT(generator.GetChunkCount(), 1);
+
+  // several observers skip rebuilding the same way
+  snapshot = generator.GetSnapshot();
+  generator.UpdateChunkData(std::vector<glm::vec3> { glm::vec3(1600.0, 0.0, 400.0), glm::vec3(200.0, 0.0, 200.0) });
+  ASSERT_EQ(generator.GetViewCount(), 2);
+  auto multi_snapshot = generator.GetSnapshot();
+  generator.UpdateChunkData(std::vector<glm::vec3> { glm::vec3(1600.0, 0.0, 400.0), glm::vec3(200.02, 0.0, 200.05) });
+  EXPECT_EQ(generator.GetSnapshot(), multi_snapshot);
+
+  // a multi-view update in between means the next single position update publishes again
+  generator.UpdateChunkData(glm::vec3(1600.0, 0.0, 400.0));
+  EXPECT_EQ(generator.GetViewCount(), 1);
+  EXPECT_EQ(generator.GetChunkCount(), snapshot->GetChunkCount());
+}
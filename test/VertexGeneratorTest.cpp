@@ -3,6 +3,7 @@
 #include <gtest/gtest.h>
 
 #include "terrain/VertexGenerator.hpp"
+#include "lod/lod_leaf_index.hpp"
 #include "lod/lod_node.hpp"
 
 using namespace terraingen;
@@ -150,4 +151,197 @@ TEST(VertexGeneratorTest, SimpleEdgeCaseTest) {
   ASSERT_NEAR(test.tangent.x, 1.0f, 0.0001f);
   ASSERT_NEAR(test.tangent.y, 0.0f, 0.0001f);
   ASSERT_NEAR(test.tangent.z, 0.0f, 0.0001f);
-}
\ No newline at end of file
+}
+
+struct DummySample_Rolling {
+  float Get(int x, int y) {
+    return static_cast<float>(sin(0.3 * x) * 4.0 + cos(0.17 * y) * 3.0);
+  }
+};
+
+TEST(VertexGeneratorTest, RowKernelMatchesScalar) {
+  std::shared_ptr<DummySample_Rolling> heightmap = std::make_shared<DummySample_Rolling>();
+  glm::vec3 offset(12.0f, 1.5f, -40.0f);
+  VertexGenerator gen(heightmap, 2.0f, (1.0 / 128.0), 64, 128, offset);
+  lod_node* node = lod_node::lod_node_alloc();
+
+  // odd count to exercise the leftovers
+  const long step = 2;
+  const size_t count = 29;
+  const long offset_x = 6;
+  const long offset_y = 22;
+
+  std::vector<float> center(count + 2), down(count), up(count);
+  for (size_t i = 0; i < count + 2; i++) {
+    center[i] = heightmap->Get(offset_x + (static_cast<long>(i) - 1) * step, offset_y);
+  }
+
+  for (size_t i = 0; i < count; i++) {
+    down[i] = heightmap->Get(offset_x + i * step, offset_y - step);
+    up[i] = heightmap->Get(offset_x + i * step, offset_y + step);
+  }
+
+  VertexRowInput input { center.data() + 1, down.data(), up.data(), offset_x, offset_y, step, count };
+
+  for (SimdLevel level : { SCALAR, SSE, AVX2 }) {
+    std::vector<Vertex> row(count);
+    VertexStreams streams { &row[0].position, &row[0].normal, &row[0].texcoord, &row[0].tangent, sizeof(Vertex) };
+    CreateVertexRow(input, 2.0f, static_cast<float>(1.0 / 128.0), offset, streams, level);
+
+    for (size_t i = 0; i < count; i++) {
+      Vertex expected = gen.CreateVertex(offset_x + i * step, offset_y, step, node);
+      EXPECT_NEAR(glm::length(row[i].position - expected.position), 0.0f, 1e-5f);
+      EXPECT_NEAR(glm::length(row[i].normal - expected.normal), 0.0f, 1e-6f);
+      EXPECT_NEAR(glm::length(row[i].texcoord - expected.texcoord), 0.0f, 1e-6f);
+      EXPECT_NEAR(glm::length(row[i].tangent - expected.tangent), 0.0f, 1e-6f);
+    }
+  }
+
+  lod_node::lod_node_free(node);
+}
+
+struct DummySample_Plane {
+  size_t samples = 0;
+  float Get(int x, int y) {
+    samples++;
+    return 0.5f * x + 0.25f * y;
+  }
+};
+
+struct DummySample_PlaneGradient {
+  size_t samples = 0;
+  float Get(int x, int y) {
+    samples++;
+    return 0.5f * x + 0.25f * y;
+  }
+
+  float GetWithGradient(int x, int y, float* grad_x, float* grad_y) {
+    *grad_x = 0.5f;
+    *grad_y = 0.25f;
+    return Get(x, y);
+  }
+};
+
+TEST(VertexGeneratorTest, AnalyticGradientMatchesFiniteDifference) {
+  static_assert(traits::height_map_gradient<DummySample_PlaneGradient>::value);
+  static_assert(!traits::height_map_gradient<DummySample_Plane>::value);
+
+  std::shared_ptr<DummySample_Plane> plane = std::make_shared<DummySample_Plane>();
+  std::shared_ptr<DummySample_PlaneGradient> plane_gradient = std::make_shared<DummySample_PlaneGradient>();
+  VertexGenerator gen(plane, 2.0f, (1.0 / 128.0), 32, 128, glm::vec3(0, 0, 0));
+  VertexGenerator gen_gradient(plane_gradient, 2.0f, (1.0 / 128.0), 32, 128, glm::vec3(0, 0, 0));
+  lod_node* node = lod_node::lod_node_alloc();
+  node->bl = lod_node::lod_node_alloc();
+  node->br = lod_node::lod_node_alloc();
+  node->tl = lod_node::lod_node_alloc();
+  node->tr = lod_node::lod_node_alloc();
+
+  // interior, then a corner
+  for (glm::ivec2 point : { glm::ivec2(20, 12), glm::ivec2(64, 64) }) {
+    plane_gradient->samples = 0;
+    Vertex expected = gen.CreateVertex(point.x, point.y, 2, node);
+    Vertex test = gen_gradient.CreateVertex(point.x, point.y, 2, node);
+    EXPECT_EQ(plane_gradient->samples, 1);
+
+    EXPECT_NEAR(glm::length(test.position - expected.position), 0.0f, 0.0001f);
+    EXPECT_NEAR(glm::length(test.normal - expected.normal), 0.0f, 0.0001f);
+    EXPECT_NEAR(glm::length(test.texcoord - expected.texcoord), 0.0f, 0.0001f);
+    EXPECT_NEAR(glm::length(test.tangent - expected.tangent), 0.0f, 0.0001f);
+  }
+
+  lod_node::lod_node_free(node);
+}
+
+TEST(VertexGeneratorTest, NeighbourTableMatchesTreeWalk) {
+  std::shared_ptr<DummySample_Rolling> heightmap = std::make_shared<DummySample_Rolling>();
+  VertexGenerator gen(heightmap, 2.0f, (1.0 / 128.0), 8, 128, glm::vec3(0, 0, 0));
+
+  // 64 -> 32 -> 16 -> 8 around the middle
+  lod_node* node = lod_node::lod_node_alloc();
+  lod_node* parent = node;
+  for (int i = 0; i < 3; i++) {
+    parent->bl = lod_node::lod_node_alloc();
+    parent->br = lod_node::lod_node_alloc();
+    parent->tl = lod_node::lod_node_alloc();
+    parent->tr = lod_node::lod_node_alloc();
+    parent = (i == 0 ? parent->tr : parent->bl);
+  }
+
+  // leaves bordering finer and coarser neighbors
+  struct leaf { long x; long y; size_t size; };
+  lod_neighbours neighbours;
+  lod_leaf_index index;
+  index.Build(node, 128);
+  for (leaf l : { leaf { 64, 64, 16 }, leaf { 64, 80, 16 }, leaf { 80, 64, 16 }, leaf { 0, 64, 64 }, leaf { 64, 0, 64 }, leaf { 96, 96, 32 } }) {
+    size_t step = l.size / 8;
+    neighbours.Build(node, 128, l.x, l.y, l.size, 8);
+    for (int i = 0; i <= 8; i++) {
+      for (glm::ivec2 vert : { glm::ivec2(i, 0), glm::ivec2(i, 8), glm::ivec2(0, i), glm::ivec2(8, i) }) {
+        long x = l.x + vert.x * step;
+        long y = l.y + vert.y * step;
+        Vertex expected = gen.CreateVertex(x, y, step, node);
+        Vertex test = gen.CreateVertex(x, y, step, neighbours);
+        EXPECT_EQ(test.position, expected.position);
+        EXPECT_EQ(test.normal, expected.normal);
+        EXPECT_EQ(test.tangent, expected.tangent);
+
+        Vertex indexed = gen.CreateVertex(x, y, step, index);
+        EXPECT_EQ(indexed.position, expected.position);
+        EXPECT_EQ(indexed.normal, expected.normal);
+        EXPECT_EQ(indexed.tangent, expected.tangent);
+      }
+    }
+  }
+
+  lod_node::lod_node_free(node);
+}
+
+struct DummySample_Counting {
+  size_t samples = 0;
+  float Get(int x, int y) {
+    samples++;
+    return static_cast<float>(sin(0.3 * x) * 4.0 + cos(0.17 * y) * 3.0);
+  }
+};
+
+TEST(VertexGeneratorTest, VertexCacheSharesBorders) {
+  std::shared_ptr<DummySample_Counting> heightmap = std::make_shared<DummySample_Counting>();
+  std::shared_ptr<DummySample_Counting> heightmap_cached = std::make_shared<DummySample_Counting>();
+  VertexCache cache(4096);
+  VertexGenerator gen(heightmap, 2.0f, (1.0 / 128.0), 8, 128, glm::vec3(0, 0, 0));
+  VertexGenerator gen_cached(heightmap_cached, 2.0f, (1.0 / 128.0), 8, 128, glm::vec3(0, 0, 0), &cache);
+
+  // left half is coarse, right half is fine
+  lod_node* node = lod_node::lod_node_alloc();
+  node->bl = lod_node::lod_node_alloc();
+  node->br = lod_node::lod_node_alloc();
+  node->tl = lod_node::lod_node_alloc();
+  node->tr = lod_node::lod_node_alloc();
+  for (lod_node* child : { node->br, node->tr }) {
+    child->bl = lod_node::lod_node_alloc();
+    child->br = lod_node::lod_node_alloc();
+    child->tl = lod_node::lod_node_alloc();
+    child->tr = lod_node::lod_node_alloc();
+  }
+
+  // walk the seam from both sides
+  for (int pass = 0; pass < 2; pass++) {
+    for (long y = 0; y <= 128; y++) {
+      size_t step = (pass == 0 ? 8 : 4);
+      if (y % step != 0) {
+        continue;
+      }
+
+      Vertex expected = gen.CreateVertex(64, y, step, node);
+      Vertex test = gen_cached.CreateVertex(64, y, step, node);
+      EXPECT_EQ(test.position, expected.position);
+      EXPECT_EQ(test.normal, expected.normal);
+      EXPECT_EQ(test.texcoord, expected.texcoord);
+      EXPECT_EQ(test.tangent, expected.tangent);
+    }
+  }
+
+  EXPECT_LT(heightmap_cached->samples * 2, heightmap->samples);
+
+  lod_node::lod_node_free(node);
+}
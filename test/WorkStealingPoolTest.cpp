@@ -0,0 +1,59 @@
+#include <gtest/gtest.h>
+
+#include "util/WorkStealingPool.hpp"
+
+#include <atomic>
+#include <vector>
+
+using namespace terraingen;
+using namespace util;
+
+TEST(WorkStealingPoolTest, RunsEverySubmittedTask) {
+  std::atomic<int> count(0);
+  {
+    WorkStealingPool pool(3);
+    for (int i = 0; i < 1000; i++) {
+      pool.Submit([&count] { count++; });
+    }
+  }
+
+  // destructor finishes the queue
+  ASSERT_EQ(count.load(), 1000);
+}
+
+TEST(WorkStealingPoolTest, NoThreadsRunsOnCaller) {
+  WorkStealingPool pool(0);
+  int count = 0;
+  pool.Submit([&count] { count++; });
+  ASSERT_EQ(count, 1);
+  ASSERT_EQ(pool.GetConcurrency(), 1);
+}
+
+TEST(WorkStealingPoolTest, ParallelForVisitsEachIndexOnce) {
+  WorkStealingPool pool(3);
+  ASSERT_EQ(pool.GetConcurrency(), 4);
+
+  std::vector<std::atomic<int>> visits(4096);
+  pool.ParallelFor(visits.size(), [&visits](size_t i) { visits[i]++; });
+  for (auto& visit : visits) {
+    ASSERT_EQ(visit.load(), 1);
+  }
+}
+
+TEST(WorkStealingPoolTest, NestedParallelForFinishes) {
+  // every worker blocks in an inner loop - callers have to pick up the slack
+  WorkStealingPool pool(2);
+  std::atomic<int> count(0);
+  pool.ParallelFor(8, [&pool, &count](size_t) {
+    pool.ParallelFor(64, [&count](size_t) { count++; });
+  });
+
+  ASSERT_EQ(count.load(), 8 * 64);
+}
+
+TEST(WorkStealingPoolTest, InlineExecutorRunsInOrder) {
+  InlineExecutor executor;
+  std::vector<size_t> order;
+  executor.ParallelFor(5, [&order](size_t i) { order.push_back(i); });
+  ASSERT_EQ(order, std::vector<size_t>({ 0, 1, 2, 3, 4 }));
+}